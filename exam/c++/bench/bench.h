@@ -0,0 +1,232 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+// A small benchmark harness, in the spirit of Google Benchmark but without dependencies.
+//
+// Every benchmark times `op(i)` for i in [0, n) in batches of consecutive operations, after some
+// untimed warmup repetitions; each batch gives one sample in nanoseconds per operation, and the
+// samples of all the repetitions are summarized with their percentiles. The results are printed
+// as a table and can be written as JSON or CSV, to be compared across commits.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <ctime>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+    struct config {
+        unsigned int warmup{1};
+        unsigned int repetitions{5};
+        std::size_t batch{1000};  // operations per sample
+    };
+
+    struct summary {
+        std::size_t samples{0};
+        double min{0}, p50{0}, p90{0}, p99{0}, max{0}, mean{0}, stddev{0};
+    };
+
+    // Nearest-rank percentiles of the samples.
+    inline summary summarize(std::vector<double> samples) {
+        summary s;
+        if (samples.empty())
+            return s;
+
+        std::sort(samples.begin(), samples.end());
+        auto rank = [&samples](double p) {
+            std::size_t i = (std::size_t)std::ceil(p * samples.size());
+            return samples[i ? i - 1 : 0];
+        };
+
+        s.samples = samples.size();
+        s.min = samples.front();
+        s.max = samples.back();
+        s.p50 = rank(0.50);
+        s.p90 = rank(0.90);
+        s.p99 = rank(0.99);
+        for (double x : samples)
+            s.mean += x;
+        s.mean /= samples.size();
+        for (double x : samples)
+            s.stddev += (x - s.mean) * (x - s.mean);
+        s.stddev = std::sqrt(s.stddev / samples.size());
+        return s;
+    }
+
+    struct record {
+        std::string structure, operation, distribution;
+        std::size_t size;
+        summary ns_per_op;
+    };
+
+    class suite {
+        config _config;
+        std::vector<record> _records;
+
+       public:
+        explicit suite(config c) : _config{c} {}
+
+        const std::vector<record> &records() const noexcept { return _records; }
+
+        // Run `setup()` (untimed) before every repetition, then time `op(i)` for i in [0, n).
+        // `batch` overrides the configured number of operations per sample, e.g. to time a whole
+        // bulk load as one sample.
+        template <typename Setup, typename Op>
+        const record &run(const std::string &structure,
+                          const std::string &operation,
+                          const std::string &distribution,
+                          std::size_t size,
+                          std::size_t n,
+                          Setup setup,
+                          Op op,
+                          std::size_t batch = 0) {
+            using clock = std::chrono::steady_clock;
+            std::vector<double> samples;
+            batch = std::max<std::size_t>(1, std::min(batch ? batch : _config.batch, n));
+
+            for (unsigned int rep = 0; rep < _config.warmup + _config.repetitions; rep++) {
+                setup();
+                for (std::size_t first = 0; first < n; first += batch) {
+                    std::size_t last = std::min(first + batch, n);
+                    auto start = clock::now();
+                    for (std::size_t i = first; i < last; i++)
+                        op(i);
+                    std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+
+                    if (rep >= _config.warmup)
+                        samples.push_back(elapsed.count() / (last - first));
+                }
+            }
+
+            _records.push_back(
+                record{structure, operation, distribution, size, summarize(samples)});
+            return _records.back();
+        }
+
+        void write_table(std::ostream &out) const {
+            out << std::left << std::setw(32) << "structure" << std::setw(12) << "operation"
+                << std::setw(12) << "distribution" << std::right << std::setw(10) << "size"
+                << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+                << std::setw(10) << "min" << "  [ns/op]\n";
+
+            out << std::fixed << std::setprecision(1);
+            for (const record &r : _records) {
+                out << std::left << std::setw(32) << r.structure << std::setw(12) << r.operation
+                    << std::setw(12) << r.distribution << std::right << std::setw(10) << r.size
+                    << std::setw(10) << r.ns_per_op.p50 << std::setw(10) << r.ns_per_op.p90
+                    << std::setw(10) << r.ns_per_op.p99 << std::setw(10) << r.ns_per_op.min
+                    << "\n";
+            }
+            out << std::defaultfloat;
+        }
+
+        // One row per statistic, in long format: structure,operation,distribution,size,statistic,
+        // value; the values are in ns per operation.
+        void write_csv(std::ostream &out, bool header = true) const {
+            if (header)
+                out << "structure,operation,distribution,size,statistic,value\n";
+
+            out << std::setprecision(6);
+            for (const record &r : _records) {
+                const summary &s = r.ns_per_op;
+                const std::pair<const char *, double> stats[] = {
+                    {"min", s.min}, {"p50", s.p50}, {"p90", s.p90}, {"p99", s.p99},
+                    {"max", s.max}, {"mean", s.mean}, {"stddev", s.stddev}};
+                for (const auto &stat : stats) {
+                    out << '"' << r.structure << "\"," << r.operation << "," << r.distribution
+                        << "," << r.size << "," << stat.first << "," << stat.second << "\n";
+                }
+            }
+        }
+
+        void write_json(std::ostream &out) const {
+            char date[32];
+            std::time_t now = std::time(nullptr);
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+            out << "{\n  \"context\": {\n"
+                << "    \"date\": \"" << date << "\",\n"
+                << "    \"language\": \"c++\",\n"
+#ifdef NDEBUG
+                << "    \"build_type\": \"release\",\n"
+#else
+                << "    \"build_type\": \"debug\",\n"
+#endif
+                << "    \"warmup\": " << _config.warmup << ",\n"
+                << "    \"repetitions\": " << _config.repetitions << ",\n"
+                << "    \"batch\": " << _config.batch << "\n  },\n  \"benchmarks\": [";
+
+            out << std::setprecision(6);
+            for (std::size_t i = 0; i < _records.size(); i++) {
+                const record &r = _records[i];
+                const summary &s = r.ns_per_op;
+                out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.structure << "/"
+                    << r.operation << "/" << r.distribution << "/" << r.size << "\", "
+                    << "\"structure\": \"" << r.structure << "\", "
+                    << "\"operation\": \"" << r.operation << "\", "
+                    << "\"distribution\": \"" << r.distribution << "\", "
+                    << "\"size\": " << r.size << ",\n     \"ns_per_op\": {"
+                    << "\"samples\": " << s.samples << ", \"min\": " << s.min
+                    << ", \"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99
+                    << ", \"max\": " << s.max << ", \"mean\": " << s.mean
+                    << ", \"stddev\": " << s.stddev << "}}";
+            }
+            out << "\n  ]\n}\n";
+        }
+    };
+
+    // Key streams. The keys stored in the trees are the even numbers 0, 2, ..., 2 (size - 1), so
+    // that odd numbers are guaranteed misses.
+
+    inline std::vector<int> sequential(std::size_t size) {
+        std::vector<int> keys(size);
+        for (std::size_t i = 0; i < size; i++)
+            keys[i] = 2 * i;
+        return keys;
+    }
+
+    inline std::vector<int> shuffled(std::size_t size, std::mt19937 &generator) {
+        std::vector<int> keys = sequential(size);
+        std::shuffle(keys.begin(), keys.end(), generator);
+        return keys;
+    }
+
+    inline std::vector<int> uniform(std::size_t size, std::size_t n, std::mt19937 &generator) {
+        std::uniform_int_distribution<std::size_t> rank{0, size - 1};
+        std::vector<int> keys(n);
+        for (int &key : keys)
+            key = 2 * rank(generator);
+        return keys;
+    }
+
+    // Zipf-distributed ranks, by inversion of the cumulative distribution: rank k (from 1) has
+    // probability proportional to 1 / k^exponent. Ranks are mapped to keys through a random
+    // permutation, so that the popular keys are scattered over the tree.
+    inline std::vector<int> zipf(std::size_t size,
+                                 std::size_t n,
+                                 std::mt19937 &generator,
+                                 double exponent = 0.99) {
+        std::vector<double> cdf(size);
+        double total = 0;
+        for (std::size_t k = 0; k < size; k++)
+            cdf[k] = total += 1.0 / std::pow(k + 1.0, exponent);
+
+        std::vector<int> by_rank = shuffled(size, generator);
+        std::uniform_real_distribution<double> u{0, total};
+        std::vector<int> keys(n);
+        for (int &key : keys) {
+            std::size_t k = std::lower_bound(cdf.begin(), cdf.end(), u(generator)) - cdf.begin();
+            key = by_rank[std::min(k, size - 1)];
+        }
+        return keys;
+    }
+}
+
+#endif
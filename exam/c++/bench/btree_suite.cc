@@ -0,0 +1,140 @@
+// Benchmark suite for BTree: insert, find-hit, find-miss, iterate, erase and balance, for
+// sequential, uniform and Zipf key distributions, on a plain tree and on one with automatic
+// rebalancing. See bench.h for the methodology.
+//
+// The distributions set the order of insertions and erasures (ascending for sequential, a random
+// permutation otherwise) and the stream of lookups (an ascending sweep, uniform, or Zipf-skewed).
+// Sequential insertions degenerate the plain tree into a list, whose quadratic cost is only
+// measured up to --max-degenerate keys. balance() is timed as a single operation on the whole
+// tree.
+//
+// usage: btree_suite.x [--sizes 1000,10000,100000] [--warmup 1] [--repetitions 5]
+//                      [--batch 1000] [--max-degenerate 20000] [--json results.json]
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "btree.h"
+
+volatile long sink;
+
+using Tree = BTree<int, int>;
+
+struct workload {
+    std::string distribution;
+    std::vector<int> insert_order, erase_order, queries;
+};
+
+workload make_workload(const std::string &distribution, std::size_t size, std::mt19937 &gen) {
+    workload w{distribution, {}, {}, {}};
+    if (distribution == "sequential") {
+        w.insert_order = w.erase_order = w.queries = bench::sequential(size);
+    } else {
+        w.insert_order = bench::shuffled(size, gen);
+        w.erase_order = bench::shuffled(size, gen);
+        w.queries = distribution == "uniform" ? bench::uniform(size, size, gen)
+                                              : bench::zipf(size, size, gen);
+    }
+    return w;
+}
+
+void run_structure(bench::suite &suite,
+                   const std::string &structure,
+                   double auto_balance,
+                   const workload &w) {
+    const std::size_t size = w.insert_order.size();
+    const std::string &dist = w.distribution;
+    Tree tree;
+
+    auto fill = [&]() {
+        tree.clear();
+        tree.auto_balance(auto_balance);
+        for (int key : w.insert_order)
+            tree.insert(key, key);
+    };
+
+    suite.run(structure, "insert", dist, size, size,
+              [&]() {
+                  tree.clear();
+                  tree.auto_balance(auto_balance);
+              },
+              [&](std::size_t i) { tree.insert(w.insert_order[i], 0); });
+
+    fill();
+    suite.run(structure, "find-hit", dist, size, size, []() {},
+              [&](std::size_t i) { sink += tree.find(w.queries[i]) != tree.cend(); });
+    suite.run(structure, "find-miss", dist, size, size, []() {},
+              [&](std::size_t i) { sink += tree.find(w.queries[i] + 1) != tree.cend(); });
+
+    Tree::const_iterator it = tree.cbegin();
+    suite.run(structure, "iterate", dist, size, size, [&]() { it = tree.cbegin(); },
+              [&](std::size_t) {
+                  sink += it.key();
+                  ++it;
+              });
+
+    suite.run(structure, "erase", dist, size, size, fill,
+              [&](std::size_t i) { tree.erase(w.erase_order[i]); });
+
+    suite.run(structure, "balance", dist, size, 1, fill, [&](std::size_t) { tree.balance(); });
+}
+
+std::vector<std::size_t> parse_sizes(const char *list) {
+    std::vector<std::size_t> sizes;
+    std::stringstream stream{list};
+    std::string item;
+    while (std::getline(stream, item, ','))
+        sizes.push_back(std::strtoul(item.c_str(), nullptr, 10));
+    return sizes;
+}
+
+int main(int argc, char **argv) {
+    bench::config config;
+    std::vector<std::size_t> sizes{1000, 10000, 100000};
+    std::size_t max_degenerate = 20000;
+    const char *json = nullptr;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--sizes") == 0)
+            sizes = parse_sizes(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            config.warmup = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--repetitions") == 0)
+            config.repetitions = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--batch") == 0)
+            config.batch = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--max-degenerate") == 0)
+            max_degenerate = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--json") == 0)
+            json = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    bench::suite suite{config};
+    std::mt19937 generator{314};
+
+    for (std::size_t size : sizes) {
+        for (const char *distribution : {"sequential", "uniform", "zipf"}) {
+            workload w = make_workload(distribution, size, generator);
+
+            if (w.distribution != "sequential" or size <= max_degenerate)
+                run_structure(suite, "BTree", 0, w);
+            run_structure(suite, "BTree+auto2", 2, w);
+        }
+    }
+
+    suite.write_table(std::cout);
+    if (json) {
+        std::ofstream out{json};
+        suite.write_json(out);
+    }
+}
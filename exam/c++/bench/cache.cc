@@ -0,0 +1,154 @@
+// LRU caches on BTree: BTreeCache, with the recency links in the nodes, against a BTree index
+// plus a separate std::list for the recency order, where a hit moves the list node and an
+// eviction looks up the victim's key in the tree. See bench.h for the methodology.
+//
+// The workload is read-through: get(key), and put(key) on a miss, with session-like string keys
+// drawn uniformly or Zipf-distributed among `4 * capacity`. BTreeCache also runs with a time to
+// live long enough that nothing expires, to show the cost of the expiry list. The memory is the
+// heap requested per cached entry, counted by alloc_counter.h.
+//
+// usage: cache.x [--capacity 50000] [--warmup 1] [--repetitions 5]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define ALLOC_COUNTER_IMPLEMENT
+#include "alloc_counter.h"
+#include "bench.h"
+#include "btree.h"
+#include "btree_cache.h"
+
+volatile long sink;
+
+struct intrusive_adapter {
+    static const char *name() { return "BTreeCache"; }
+    BTreeCache<std::string, long> c;
+
+    explicit intrusive_adapter(std::size_t capacity) : c{capacity} {}
+    bool get_or_put(const std::string &k) {
+        if (c.get(k))
+            return true;
+        c.put(k, 0);
+        return false;
+    }
+};
+
+struct ttl_adapter {
+    static const char *name() { return "BTreeCache (ttl)"; }
+    BTreeCache<std::string, long> c;
+
+    explicit ttl_adapter(std::size_t capacity) : c{capacity, std::chrono::hours{1}} {}
+    bool get_or_put(const std::string &k) {
+        if (c.get(k))
+            return true;
+        c.put(k, 0);
+        return false;
+    }
+};
+
+struct external_list_adapter {
+    static const char *name() { return "BTree + std::list"; }
+    using recency = std::list<std::string>;
+    BTree<std::string, std::pair<long, recency::iterator>> index;
+    recency order;  // most recently used first
+    std::size_t capacity;
+
+    explicit external_list_adapter(std::size_t capacity) : capacity{capacity} {
+        index.auto_balance(2);
+    }
+    bool get_or_put(const std::string &k) {
+        auto it = index.find(k);
+        if (it != index.end()) {
+            order.splice(order.begin(), order, it.val().second);
+            return true;
+        }
+        order.push_front(k);
+        index.insert(k, {0, order.begin()});
+        if (index.size() > capacity) {
+            index.erase(order.back());
+            order.pop_back();
+        }
+        return false;
+    }
+};
+
+std::vector<std::string> sessions(const std::vector<int> &keys) {
+    std::vector<std::string> result;
+    result.reserve(keys.size());
+    char buffer[32];
+    for (int key : keys) {
+        std::snprintf(buffer, sizeof(buffer), "session:%08d", key);
+        result.push_back(buffer);
+    }
+    return result;
+}
+
+template <typename Adapter>
+void run(bench::suite &suite,
+         std::size_t capacity,
+         const std::string &distribution,
+         const std::vector<std::string> &keys,
+         const std::vector<std::string> &distinct) {
+    Adapter *a = nullptr;
+    long hits = 0;
+
+    suite.run(Adapter::name(), "get-or-put", distribution, capacity, keys.size(),
+              [&]() {
+                  delete a;
+                  a = new Adapter{capacity};
+                  hits = 0;
+              },
+              [&](std::size_t i) { hits += a->get_or_put(keys[i]); });
+    sink += hits;
+    delete a;
+
+    alloc_counter::scope filling;
+    Adapter filled{capacity};
+    for (std::size_t i = 0; i < capacity; i++)
+        filled.get_or_put(distinct[i]);
+    std::cout << Adapter::name() << ", " << distribution << ": hit ratio "
+              << double(hits) / keys.size() << ", "
+              << double(filling.live_bytes()) / capacity << " bytes per entry\n";
+}
+
+int main(int argc, char **argv) {
+    bench::config config;
+    std::size_t capacity = 50000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--capacity") == 0)
+            capacity = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            config.warmup = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--repetitions") == 0)
+            config.repetitions = std::atoi(argv[i + 1]);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    bench::suite suite{config};
+    std::mt19937 generator{314};
+    const std::size_t key_space = 4 * capacity, n = 10 * capacity;
+    std::vector<std::string> uniform = sessions(bench::uniform(key_space, n, generator));
+    std::vector<std::string> zipf = sessions(bench::zipf(key_space, n, generator));
+    std::vector<std::string> distinct = sessions(bench::sequential(capacity));
+
+    for (const char *distribution : {"uniform", "zipf"}) {
+        const std::vector<std::string> &keys = std::strcmp(distribution, "zipf") ? uniform : zipf;
+        run<intrusive_adapter>(suite, capacity, distribution, keys, distinct);
+        run<ttl_adapter>(suite, capacity, distribution, keys, distinct);
+        run<external_list_adapter>(suite, capacity, distribution, keys, distinct);
+    }
+
+    std::cout << "\n";
+    suite.write_table(std::cout);
+}
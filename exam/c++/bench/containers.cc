@@ -0,0 +1,320 @@
+// BTree against the standard containers it could replace: std::map, std::unordered_map and a
+// sorted std::vector searched with binary search, on identical workloads, for several key and
+// value types. See bench.h for the methodology.
+//
+// Workloads, on `size` keys in random order:
+//   bulk-insert  build the container from the unsorted pairs (the vector sorts them once at the
+//                end), timed as a single sample;
+//   find         uniformly random lookups of existing keys;
+//   range-scan   lower_bound of a random key, then the next 100 pairs (not for unordered_map);
+//   erase-churn  erase an existing key and insert a new one, the container size staying constant.
+// The memory footprint is the heap requested by the bulk insertion, per pair, counted by
+// replacing the global operator new (see alloc_counter.h); for BTree it is shown next to the
+// BTree::memory_usage() estimate, which adds the allocator overhead.
+//
+// usage: containers.x [--sizes 1000,100000] [--warmup 1] [--repetitions 5] [--csv results.csv]
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define ALLOC_COUNTER_IMPLEMENT
+#include "alloc_counter.h"
+#include "bench.h"
+#include "btree.h"
+
+volatile long sink;
+
+template <typename T>
+struct type_name;
+template <>
+struct type_name<int> {
+    static const char *get() { return "int"; }
+};
+template <>
+struct type_name<long long> {
+    static const char *get() { return "long"; }
+};
+template <>
+struct type_name<double> {
+    static const char *get() { return "double"; }
+};
+template <>
+struct type_name<std::string> {
+    static const char *get() { return "string"; }
+};
+
+// Keys and values from integers; string keys keep the integer order and are long enough to live
+// on the heap.
+template <typename T>
+T make(long i) {
+    return static_cast<T>(i);
+}
+template <>
+std::string make<std::string>(long i) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "key-%020ld", i);
+    return buffer;
+}
+
+template <typename T>
+long value_of(const T &x) {
+    return static_cast<long>(x);
+}
+long value_of(const std::string &x) {
+    return x.size();
+}
+
+// Adapters giving the containers the same interface.
+
+template <typename K, typename V>
+struct btree_adapter {
+    static const char *name() { return "BTree"; }
+    static constexpr bool ordered = true;
+    BTree<K, V> c;
+
+    void clear() { c.clear(); }
+    void add(const K &k, const V &v) { c.insert(k, v); }
+    void done() {}
+    void insert(const K &k, const V &v) { c.insert(k, v); }
+    bool find(const K &k) const { return c.find(k) != c.cend(); }
+    void erase(const K &k) { c.erase(k); }
+    std::size_t reported() const { return c.memory_usage().total() - sizeof(c); }
+    long scan(const K &k, int count) const {
+        long sum = 0;
+        for (auto it = c.lower_bound(k); it != c.cend() and count--; ++it)
+            sum += value_of(it.val());
+        return sum;
+    }
+};
+
+template <typename Map>
+struct map_adapter {
+    using K = typename Map::key_type;
+    using V = typename Map::mapped_type;
+    Map c;
+
+    void clear() { c.clear(); }
+    void add(const K &k, const V &v) { c.emplace(k, v); }
+    void done() {}
+    void insert(const K &k, const V &v) { c.emplace(k, v); }
+    bool find(const K &k) const { return c.find(k) != c.end(); }
+    void erase(const K &k) { c.erase(k); }
+    std::size_t reported() const { return 0; }
+};
+
+template <typename K, typename V>
+struct std_map_adapter : map_adapter<std::map<K, V>> {
+    static const char *name() { return "std::map"; }
+    static constexpr bool ordered = true;
+
+    long scan(const K &k, int count) const {
+        long sum = 0;
+        for (auto it = this->c.lower_bound(k); it != this->c.end() and count--; ++it)
+            sum += value_of(it->second);
+        return sum;
+    }
+};
+
+template <typename K, typename V>
+struct unordered_map_adapter : map_adapter<std::unordered_map<K, V>> {
+    static const char *name() { return "std::unordered_map"; }
+    static constexpr bool ordered = false;
+
+    long scan(const K &, int) const { return 0; }
+};
+
+template <typename K, typename V>
+struct sorted_vector_adapter {
+    static const char *name() { return "sorted vector"; }
+    static constexpr bool ordered = true;
+    std::vector<std::pair<K, V>> c;
+
+    static bool less(const std::pair<K, V> &a, const K &k) { return a.first < k; }
+    std::size_t reported() const { return 0; }
+
+    void clear() {
+        c.clear();
+        c.shrink_to_fit();
+    }
+    void add(const K &k, const V &v) { c.emplace_back(k, v); }
+    void done() {
+        std::sort(c.begin(), c.end(), [](const std::pair<K, V> &a, const std::pair<K, V> &b) {
+            return a.first < b.first;
+        });
+    }
+    bool find(const K &k) const {
+        auto it = std::lower_bound(c.begin(), c.end(), k, less);
+        return it != c.end() and not(k < it->first);
+    }
+    void erase(const K &k) {
+        auto it = std::lower_bound(c.begin(), c.end(), k, less);
+        if (it != c.end() and not(k < it->first))
+            c.erase(it);
+    }
+    void insert(const K &k, const V &v) {
+        c.emplace(std::lower_bound(c.begin(), c.end(), k, less), k, v);
+    }
+    long scan(const K &k, int count) const {
+        long sum = 0;
+        for (auto it = std::lower_bound(c.begin(), c.end(), k, less); it != c.end() and count--;
+             ++it)
+            sum += value_of(it->second);
+        return sum;
+    }
+};
+
+struct memory_record {
+    std::string structure;
+    std::size_t size;
+    double bytes_per_pair;
+    double reported_per_pair;  // zero if the structure does not report its own footprint
+};
+
+template <typename Adapter, typename K, typename V>
+void run_container(bench::suite &suite,
+                   std::vector<memory_record> &memory,
+                   std::size_t size,
+                   std::mt19937 &generator) {
+    const std::string structure = std::string{Adapter::name()} + "<" + type_name<K>::get() + "," +
+                                  type_name<V>::get() + ">";
+    const std::size_t churn = std::min<std::size_t>(size, 5000), scans = churn;
+
+    // The stored keys are the even numbers below 2 * size; the churn inserts keys from 2 * size
+    // on, so that they are always new.
+    std::vector<K> keys, lookups, erased, added;
+    std::vector<V> values;
+    for (int key : bench::shuffled(size, generator)) {
+        keys.push_back(make<K>(key));
+        values.push_back(make<V>(key));
+    }
+    for (int key : bench::uniform(size, size, generator))
+        lookups.push_back(make<K>(key));
+    for (std::size_t i = 0; i < churn; i++) {
+        erased.push_back(keys[i]);
+        added.push_back(make<K>(2 * (size + i)));
+    }
+
+    Adapter a;
+    auto fill = [&]() {
+        a.clear();
+        for (std::size_t i = 0; i < size; i++)
+            a.add(keys[i], values[i]);
+        a.done();
+    };
+
+    suite.run(structure, "bulk-insert", "uniform", size, size, [&]() { a.clear(); },
+              [&](std::size_t i) {
+                  a.add(keys[i], values[i]);
+                  if (i + 1 == size)
+                      a.done();
+              },
+              size);
+
+    a.clear();
+    alloc_counter::scope filling;
+    fill();
+    memory.push_back(memory_record{structure, size, double(filling.live_bytes()) / size,
+                                   double(a.reported()) / size});
+
+    suite.run(structure, "find", "uniform", size, size, []() {},
+              [&](std::size_t i) { sink += a.find(lookups[i]); });
+
+    if (Adapter::ordered) {
+        suite.run(structure, "range-scan", "uniform", size, scans, []() {},
+                  [&](std::size_t i) { sink += a.scan(lookups[i], 100); });
+    }
+
+    suite.run(structure, "erase-churn", "uniform", size, churn, fill, [&](std::size_t i) {
+        a.erase(erased[i]);
+        a.insert(added[i], values[i]);
+    });
+}
+
+template <typename K, typename V>
+void run_types(bench::suite &suite,
+               std::vector<memory_record> &memory,
+               std::size_t size,
+               std::mt19937 &generator) {
+    run_container<btree_adapter<K, V>, K, V>(suite, memory, size, generator);
+    run_container<std_map_adapter<K, V>, K, V>(suite, memory, size, generator);
+    run_container<unordered_map_adapter<K, V>, K, V>(suite, memory, size, generator);
+    run_container<sorted_vector_adapter<K, V>, K, V>(suite, memory, size, generator);
+}
+
+std::vector<std::size_t> parse_sizes(const char *list) {
+    std::vector<std::size_t> sizes;
+    std::stringstream stream{list};
+    std::string item;
+    while (std::getline(stream, item, ','))
+        sizes.push_back(std::strtoul(item.c_str(), nullptr, 10));
+    return sizes;
+}
+
+int main(int argc, char **argv) {
+    bench::config config;
+    std::vector<std::size_t> sizes{1000, 100000};
+    const char *csv = nullptr;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--sizes") == 0)
+            sizes = parse_sizes(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            config.warmup = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--repetitions") == 0)
+            config.repetitions = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--csv") == 0)
+            csv = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    bench::suite suite{config};
+    std::vector<memory_record> memory;
+    std::mt19937 generator{314};
+
+    for (std::size_t size : sizes) {
+        run_types<int, int>(suite, memory, size, generator);
+        run_types<long long, double>(suite, memory, size, generator);
+        run_types<std::string, int>(suite, memory, size, generator);
+    }
+
+    suite.write_table(std::cout);
+
+    std::cout << "\n" << std::left << std::setw(32) << "structure" << std::right << std::setw(10)
+              << "size" << std::setw(16) << "requested/pair" << std::setw(16) << "memory_usage()"
+              << "\n";
+    for (const memory_record &m : memory) {
+        std::cout << std::left << std::setw(32) << m.structure << std::right << std::setw(10)
+                  << m.size << std::setw(16) << std::fixed << std::setprecision(1)
+                  << m.bytes_per_pair << std::setw(16);
+        if (m.reported_per_pair > 0)
+            std::cout << m.reported_per_pair << "\n";
+        else
+            std::cout << "-" << "\n";
+    }
+
+    if (csv) {
+        std::ofstream out{csv};
+        suite.write_csv(out);
+        for (const memory_record &m : memory) {
+            out << '"' << m.structure << "\",memory,uniform," << m.size << ",bytes_per_pair,"
+                << m.bytes_per_pair << "\n";
+            if (m.reported_per_pair > 0) {
+                out << '"' << m.structure << "\",memory,uniform," << m.size
+                    << ",reported_bytes_per_pair," << m.reported_per_pair << "\n";
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+// Write throughput of DurableBTree against the size of its commit groups, from an fsync per write
+// to one every 1024, and the time to recover the tree from its log and from a snapshot. The
+// files go to a fresh directory under --dir, on the local filesystem by default; the numbers
+// depend mostly on how long the disk takes to sync.
+//
+// usage: durable.x [--writes 20000] [--dir /tmp]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "btree_wal.h"
+
+using Durable = DurableBTree<int, long>;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void remove_files(const std::string &directory) {
+    for (const char *file : {"/log", "/snapshot", "/snapshot.tmp"})
+        std::remove((directory + file).c_str());
+}
+
+int main(int argc, char **argv) {
+    std::size_t n_writes = 20000;
+    std::string parent = "/tmp";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--writes") == 0)
+            n_writes = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--dir") == 0)
+            parent = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::string name = parent + "/durable.XXXXXX";
+    if (mkdtemp(&name[0]) == nullptr) {
+        std::perror(("cannot create a directory in " + parent).c_str());
+        return 1;
+    }
+    const std::string directory = name;
+
+    std::mt19937 generator{314};
+    std::vector<int> keys = bench::uniform(n_writes, n_writes, generator);
+
+    std::cout << std::setw(12) << "group size" << std::setw(16) << "writes/s" << std::setw(10)
+              << "fsyncs" << std::setw(16) << "log replay [s]" << std::setw(20)
+              << "snapshot load [s]" << "\n";
+
+    for (std::size_t group : {1, 8, 64, 1024}) {
+        remove_files(directory);
+        btree_wal::options options;
+        options.group_size = group;
+
+        auto start = std::chrono::steady_clock::now();
+        std::size_t syncs;
+        {
+            Durable db{directory, options};
+            for (std::size_t i = 0; i < keys.size(); i++)
+                db.insert(keys[i], i);
+            db.sync();
+            syncs = db.syncs();
+        }
+        double writing = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        Durable *replayed = new Durable{directory, options};
+        double replay = seconds_since(start);
+        replayed->snapshot();
+        delete replayed;
+
+        start = std::chrono::steady_clock::now();
+        { Durable db{directory, options}; }
+        double load = seconds_since(start);
+
+        std::cout << std::setw(12) << group << std::setw(16) << std::fixed << std::setprecision(0)
+                  << n_writes / writing << std::setw(10) << syncs << std::setw(16)
+                  << std::setprecision(4) << replay << std::setw(20) << load << "\n";
+    }
+
+    remove_files(directory);
+    std::remove(directory.c_str());
+}
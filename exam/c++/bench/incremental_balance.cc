@@ -0,0 +1,158 @@
+// Latency of the requests served by a thread that also rebalances the tree: balance() at once,
+// against balance_step() with a budget of nodes or of time before every request, and no
+// rebalancing at all. The tree is filled in random order, then grown with sorted keys that
+// degenerate a part of it into a list; every request inserts a missing key and looks up eight
+// stored ones, uniformly.
+//
+// Every request is timed together with the rebalancing done before it, since that is how long
+// the request waits. The latencies are summarized with their percentiles and a histogram of
+// power-of-two buckets, in nanoseconds; `slowed` is the number of requests that rebalanced. The
+// percentiles above the share of slowed requests are unaffected as long as the steps are short.
+//
+// usage: incremental_balance.x [--keys 1000000] [--requests 1000000]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "btree.h"
+
+volatile long sink;
+
+using Tree = BTree<int, int>;
+enum class mode { none, blocking, nodes, time };
+
+struct outcome {
+    std::vector<double> latencies;
+    unsigned int height_before, height_after;
+    std::size_t slowed{0};
+};
+
+outcome run(mode m,
+            const std::vector<int> &keys,
+            const std::vector<int> &inserts,
+            const std::vector<int> &lookups,
+            std::size_t n_requests) {
+    Tree tree;
+    for (int key : keys)
+        tree.insert(key, key);
+    int next = 2 * keys.size();
+    for (std::size_t i = 0; i < keys.size() / 100; i++, next += 2)
+        tree.insert(next, next);
+
+    outcome result;
+    result.height_before = tree.height();
+    result.latencies.reserve(n_requests);
+
+    // Rebalance from the first quarter of the requests on.
+    const std::size_t start = n_requests / 4;
+    bool balancing = false;
+
+    for (std::size_t r = 0; r < n_requests; r++) {
+        auto begin = std::chrono::steady_clock::now();
+
+        if (r == start) {
+            if (m == mode::blocking)
+                tree.balance();
+            balancing = m == mode::nodes or m == mode::time;
+        }
+        if (balancing) {
+            result.slowed++;
+            if (m == mode::nodes)
+                balancing = not tree.balance_step(1000);
+            else
+                balancing = not tree.balance_step(std::chrono::microseconds{10});
+        }
+
+        tree.insert(inserts[r], 0);
+        long found = 0;
+        for (std::size_t i = 0; i < 8; i++)
+            found += tree.find(lookups[8 * r + i]) != tree.end();
+        sink += found;
+
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        result.latencies.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    result.height_after = tree.height();
+    return result;
+}
+
+void report(const std::string &name, const outcome &o) {
+    bench::summary s = bench::summarize(o.latencies);
+    std::vector<double> sorted = o.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    double p999 = sorted[sorted.size() * 999 / 1000];
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << s.p50
+              << std::setw(10) << s.p90 << std::setw(10) << s.p99 << std::setw(10) << p999
+              << std::setw(12) << s.max << std::setw(8) << o.slowed << std::setw(8)
+              << o.height_before << std::setw(8) << o.height_after << "\n";
+}
+
+void histogram(const std::string &name, const outcome &o) {
+    std::vector<std::size_t> buckets(40, 0);
+    for (double latency : o.latencies) {
+        std::size_t b = 0;
+        while ((1ul << (b + 1)) <= latency and b + 1 < buckets.size())
+            b++;
+        buckets[b]++;
+    }
+
+    std::cout << "\n" << name << "\n";
+    for (std::size_t b = 0; b < buckets.size(); b++)
+        if (buckets[b])
+            std::cout << "  [" << std::setw(10) << (1ul << b) << ", " << std::setw(10)
+                      << (2ul << b) << ") ns  " << buckets[b] << "\n";
+}
+
+int main(int argc, char **argv) {
+    std::size_t n_keys = 1000000, n_requests = 1000000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--keys") == 0)
+            n_keys = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--requests") == 0)
+            n_requests = std::strtoul(argv[i + 1], nullptr, 10);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 generator{314};
+    std::vector<int> keys = bench::shuffled(n_keys, generator);
+    std::vector<int> lookups = bench::uniform(n_keys, 8 * n_requests, generator);
+    std::vector<int> inserts = bench::uniform(n_keys, n_requests, generator);
+    for (int &key : inserts)
+        key++;
+
+    const struct {
+        const char *name;
+        mode m;
+    } modes[] = {{"no rebalancing", mode::none},
+                 {"balance()", mode::blocking},
+                 {"balance_step(1000 nodes)", mode::nodes},
+                 {"balance_step(10 us)", mode::time}};
+
+    std::vector<outcome> outcomes;
+    std::cout << std::left << std::setw(28) << "request latency [ns]" << std::right
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(12) << "max" << std::setw(8) << "slowed"
+              << std::setw(8) << "height" << std::setw(8) << "after" << "\n";
+    for (const auto &mode : modes) {
+        outcomes.push_back(run(mode.m, keys, inserts, lookups, n_requests));
+        report(mode.name, outcomes.back());
+    }
+
+    for (std::size_t i = 0; i < outcomes.size(); i++)
+        histogram(modes[i].name, outcomes[i]);
+}
@@ -0,0 +1,86 @@
+// Batched lookups: find_interleaved() with 4 to 32 lookups at a time against a loop of find(),
+// on balanced trees of growing size, up to far larger than the last level cache. The trees are
+// filled in random order, so that the nodes of a path are scattered in memory. Each sample looks
+// up a batch of 256 uniform keys, stored or missing. See bench.h for the methodology; the times
+// are per batch.
+//
+// usage: interleaved_find.x [--max-keys 4000000] [--warmup 1] [--repetitions 5]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "btree.h"
+
+volatile long sink;
+
+using Tree = BTree<int, int>;
+const std::size_t batch = 256;
+
+template <unsigned int width>
+void interleaved(bench::suite &suite,
+                 const Tree &tree,
+                 const std::vector<int> &keys,
+                 std::vector<Tree::iterator> &results) {
+    suite.run("find_interleaved<" + std::to_string(width) + ">", "find-batch", "uniform",
+              tree.size(), keys.size() / batch, []() {},
+              [&](std::size_t i) {
+                  auto first = keys.begin() + i * batch;
+                  tree.find_interleaved<width>(first, first + batch, results.begin());
+                  sink += results[i % batch] != tree.end();
+              });
+}
+
+int main(int argc, char **argv) {
+    bench::config config;
+    config.batch = 100;
+    std::size_t max_keys = 4000000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--max-keys") == 0)
+            max_keys = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            config.warmup = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--repetitions") == 0)
+            config.repetitions = std::atoi(argv[i + 1]);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    bench::suite suite{config};
+    std::mt19937 generator{314};
+
+    for (std::size_t size = 10000; size <= max_keys; size *= 20) {
+        Tree tree;
+        tree.auto_balance(2);
+        for (int key : bench::shuffled(size, generator))
+            tree.insert(key, key);
+        tree.balance();
+
+        // Stored keys are even: half of the lookups miss.
+        std::vector<int> keys = bench::uniform(2 * size, 2000 * batch, generator);
+        for (std::size_t i = 0; i < keys.size(); i++)
+            keys[i] /= 2;
+        std::vector<Tree::iterator> results(batch, tree.end());
+
+        suite.run("find", "find-batch", "uniform", size, keys.size() / batch, []() {},
+                  [&](std::size_t i) {
+                      long found = 0;
+                      for (std::size_t j = i * batch; j < (i + 1) * batch; j++)
+                          found += tree.find(keys[j]) != tree.end();
+                      sink += found;
+                  });
+        interleaved<4>(suite, tree, keys, results);
+        interleaved<8>(suite, tree, keys, results);
+        interleaved<16>(suite, tree, keys, results);
+        interleaved<32>(suite, tree, keys, results);
+    }
+
+    std::cout << "\n";
+    suite.write_table(std::cout);
+}
@@ -0,0 +1,135 @@
+// Duplicate keys: BTreeMultimap against a BTree of std::vector and std::multimap, on a time
+// series whose timestamps collide, `duplicates` samples per timestamp, inserted in time order.
+// The trees rebalance automatically. See bench.h for the methodology.
+//
+// Operations: insert one sample, count(timestamp), and equal_range(timestamp) summing its values.
+// The memory is the heap requested per sample, counted by alloc_counter.h.
+//
+// usage: multimap.x [--samples 100000] [--warmup 1] [--repetitions 5]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ALLOC_COUNTER_IMPLEMENT
+#include "alloc_counter.h"
+#include "bench.h"
+#include "btree.h"
+#include "btree_multimap.h"
+
+volatile double sink;
+
+struct multimap_adapter {
+    static const char *name() { return "BTreeMultimap<4>"; }
+    BTreeMultimap<long, double, 4> c;
+
+    multimap_adapter() { c.auto_balance(2); }
+    void insert(long k, double v) { c.insert(k, v); }
+    std::size_t count(long k) const { return c.count(k); }
+    double sum(long k) const {
+        double total = 0;
+        auto range = c.equal_range(k);
+        for (auto it = range.first; it != range.second; ++it)
+            total += *it;
+        return total;
+    }
+};
+
+struct vector_adapter {
+    static const char *name() { return "BTree<vector>"; }
+    BTree<long, std::vector<double>> c;
+
+    vector_adapter() { c.auto_balance(2); }
+    void insert(long k, double v) { c[k].push_back(v); }
+    std::size_t count(long k) const {
+        auto it = c.find(k);
+        return it == c.end() ? 0 : it.val().size();
+    }
+    double sum(long k) const {
+        double total = 0;
+        auto it = c.find(k);
+        if (it != c.end())
+            for (double v : it.val())
+                total += v;
+        return total;
+    }
+};
+
+struct std_multimap_adapter {
+    static const char *name() { return "std::multimap"; }
+    std::multimap<long, double> c;
+
+    void insert(long k, double v) { c.emplace(k, v); }
+    std::size_t count(long k) const { return c.count(k); }
+    double sum(long k) const {
+        double total = 0;
+        auto range = c.equal_range(k);
+        for (auto it = range.first; it != range.second; ++it)
+            total += it->second;
+        return total;
+    }
+};
+
+template <typename Adapter>
+void run(bench::suite &suite,
+         std::size_t samples,
+         unsigned int duplicates,
+         const std::vector<int> &queries) {
+    const std::string distribution = "dup" + std::to_string(duplicates);
+    Adapter *a = nullptr;
+
+    suite.run(Adapter::name(), "insert", distribution, samples, samples,
+              [&]() {
+                  delete a;
+                  a = new Adapter;
+              },
+              [&](std::size_t i) { a->insert(i / duplicates, i); });
+
+    suite.run(Adapter::name(), "count", distribution, samples, queries.size(), []() {},
+              [&](std::size_t i) { sink += a->count(queries[i] / 2 / duplicates); });
+    suite.run(Adapter::name(), "equal_range", distribution, samples, queries.size(), []() {},
+              [&](std::size_t i) { sink += a->sum(queries[i] / 2 / duplicates); });
+
+    delete a;
+    alloc_counter::scope filling;
+    Adapter filled;
+    for (std::size_t i = 0; i < samples; i++)
+        filled.insert(i / duplicates, i);
+    std::cout << Adapter::name() << ", " << duplicates << " per key: "
+              << double(filling.live_bytes()) / samples << " bytes per sample\n";
+}
+
+int main(int argc, char **argv) {
+    bench::config config;
+    std::size_t samples = 100000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--samples") == 0)
+            samples = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            config.warmup = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--repetitions") == 0)
+            config.repetitions = std::atoi(argv[i + 1]);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    bench::suite suite{config};
+    std::mt19937 generator{314};
+    std::vector<int> queries = bench::uniform(samples, samples, generator);
+
+    for (unsigned int duplicates : {1, 2, 4, 16}) {
+        run<multimap_adapter>(suite, samples, duplicates, queries);
+        run<vector_adapter>(suite, samples, duplicates, queries);
+        run<std_multimap_adapter>(suite, samples, duplicates, queries);
+    }
+
+    std::cout << "\n";
+    suite.write_table(std::cout);
+}
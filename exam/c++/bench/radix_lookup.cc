@@ -0,0 +1,54 @@
+// The lookup workload of exam/mix/benchmarks.py, run natively: a tree filled with sequential keys
+// and random find() calls on existing keys, for BTree before and after balance() and RadixTree.
+//
+// usage: radix_lookup.x [tree size] [number of finds]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "btree.h"
+#include "radix.h"
+
+template <typename Tree>
+double time_finds(const Tree &tree, const std::vector<int> &test_set) {
+    long found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : test_set)
+        found += tree.find(key) != tree.cend();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (found != (long)test_set.size())
+        std::cerr << "missing keys!" << std::endl;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+    const int tree_size = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const int n_tests = argc > 2 ? std::atoi(argv[2]) : 10000;
+
+    std::mt19937 generator{314};
+    std::uniform_int_distribution<int> keys{0, tree_size - 1};
+    std::vector<int> test_set(n_tests);
+    for (int &key : test_set)
+        key = keys(generator);
+
+    BTree<int, int> btree;
+    RadixTree<int, int> radix;
+    for (int i = 0; i < tree_size; i++) {
+        btree.insert(i, 0);
+        radix.insert(i, 0);
+    }
+
+    std::cout << "tree size: " << tree_size << ", finds: " << n_tests << std::endl;
+    std::cout << "BTree, height " << btree.height() << ": " << time_finds(btree, test_set) << " s"
+              << std::endl;
+
+    btree.balance();
+    std::cout << "BTree, height " << btree.height() << ": " << time_finds(btree, test_set) << " s"
+              << std::endl;
+
+    std::cout << "RadixTree: " << time_finds(radix, test_set) << " s" << std::endl;
+}
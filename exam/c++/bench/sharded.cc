@@ -0,0 +1,87 @@
+// Write throughput against the number of threads: ShardedBTree with 16 shards, partitioned by
+// hash and by range, against a single BTree behind one rw_lock. Every thread inserts its share of
+// the keys, in random order, and then looks up one key in ten. The ranges start empty, so their
+// runs include the rebalances that spread the keys.
+//
+// usage: sharded.x [keys] [max threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "btree.h"
+#include "rw_lock.h"
+#include "sharded_btree.h"
+
+using Sharded = ShardedBTree<int, int, std::less<int>, 16>;
+
+struct LockedBTree {
+    BTree<int, int> tree;
+    rw_lock lock;
+
+    LockedBTree() { tree.auto_balance(2); }
+    void insert(int key, int value) {
+        rw_lock::write_guard guard{lock};
+        tree.insert(key, value);
+    }
+    bool contains(int key) {
+        rw_lock::read_guard guard{lock};
+        return tree.find(key) != tree.end();
+    }
+};
+
+struct HashSharded : Sharded {
+    HashSharded() : Sharded{partitioning::by_hash} {}
+};
+
+struct RangeSharded : Sharded {
+    RangeSharded() : Sharded{partitioning::by_range} {}
+};
+
+// Millions of operations per second.
+template <typename Map>
+double run(const std::vector<int> &keys, int n_threads) {
+    Map map;
+    std::vector<std::thread> threads;
+    const std::size_t share = keys.size() / n_threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&map, &keys, share, t]() {
+            const std::size_t first = t * share, last = first + share;
+            for (std::size_t i = first; i < last; i++)
+                map.insert(keys[i], t);
+            for (std::size_t i = first; i < last; i += 10)
+                map.contains(keys[i]);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return share * n_threads * 1.1 / elapsed.count() / 1e6;
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n_keys = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const int max_threads = argc > 2 ? std::atoi(argv[2]) : 32;
+
+    std::vector<int> keys(n_keys);
+    for (std::size_t i = 0; i < n_keys; i++)
+        keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{314});
+
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << "\n";
+    std::cout << "threads  btree+rw_lock[Mops/s]  sharded by hash[Mops/s]  sharded by range[Mops/s]"
+              << std::endl;
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        std::cout << n_threads << "  " << run<LockedBTree>(keys, n_threads) << "  "
+                  << run<HashSharded>(keys, n_threads) << "  "
+                  << run<RangeSharded>(keys, n_threads) << std::endl;
+    }
+}
@@ -0,0 +1,77 @@
+// Insert-heavy contention benchmark: SkipList against a BTree protected by a single mutex.
+//
+// usage: skiplist_contention.x [keys] [max threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "btree.h"
+#include "skiplist.h"
+
+struct LockedBTree {
+    BTree<int, int> tree;
+    std::mutex lock;
+
+    void insert(int key, int value) {
+        std::lock_guard<std::mutex> guard{lock};
+        tree.insert(key, value);
+    }
+    bool contains(int key) {
+        std::lock_guard<std::mutex> guard{lock};
+        return tree.find(key) != tree.end();
+    }
+};
+
+struct SharedSkipList {
+    SkipList<int, int> list;
+
+    void insert(int key, int value) { list.insert(key, value); }
+    bool contains(int key) { return list.find(key) != list.end(); }
+};
+
+// Every thread inserts its share of `keys` and then looks up one key in ten, returning the
+// throughput in millions of operations per second.
+template <typename Map>
+double run(const std::vector<int> &keys, int n_threads) {
+    Map map;
+    std::vector<std::thread> threads;
+    const std::size_t share = keys.size() / n_threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&map, &keys, share, t]() {
+            const std::size_t first = t * share, last = first + share;
+            for (std::size_t i = first; i < last; i++)
+                map.insert(keys[i], t);
+            for (std::size_t i = first; i < last; i += 10)
+                map.contains(keys[i]);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return share * n_threads * 1.1 / elapsed.count() / 1e6;
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n_keys = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const int max_threads = argc > 2 ? std::atoi(argv[2]) : 64;
+
+    std::vector<int> keys(n_keys);
+    for (std::size_t i = 0; i < n_keys; i++)
+        keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{314});
+
+    std::cout << "threads  btree+mutex[Mops/s]  skiplist[Mops/s]" << std::endl;
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        std::cout << n_threads << "  " << run<LockedBTree>(keys, n_threads) << "  "
+                  << run<SharedSkipList>(keys, n_threads) << std::endl;
+    }
+}
@@ -0,0 +1,68 @@
+// Fixed lookup tables: a StaticBTree built at compile time against a BTree filled at startup, in
+// key order like a table written in the source, and then balanced, for 16 to 4096 entries. The
+// setup column is what the BTree costs before its first lookup; the StaticBTree has none. The
+// lookups are random, on existing keys.
+//
+// usage: static_table.x [number of finds]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "btree.h"
+#include "static_btree.h"
+
+// Keys 0, 2, ..., valued by their rank.
+template <std::size_t... I>
+constexpr StaticBTree<int, int, sizeof...(I)> make_table(static_btree::indices<I...>) {
+    return StaticBTree<int, int, sizeof...(I)>{{std::pair<int, int>{2 * I, I}...}};
+}
+
+template <typename Tree>
+double time_finds(const Tree &tree, const std::vector<int> &test_set) {
+    long found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : test_set)
+        found += tree.find(key) != tree.cend();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (found != (long)test_set.size())
+        std::cerr << "missing keys!" << std::endl;
+    return elapsed.count();
+}
+
+template <std::size_t N>
+void run(int n_tests) {
+    static constexpr StaticBTree<int, int, N> table =
+        make_table(typename static_btree::make_indices<N>::type{});
+
+    std::mt19937 generator{314};
+    std::uniform_int_distribution<int> ranks{0, N - 1};
+    std::vector<int> test_set(n_tests);
+    for (int &key : test_set)
+        key = 2 * ranks(generator);
+
+    auto start = std::chrono::steady_clock::now();
+    BTree<int, int> btree;
+    for (auto it = table.begin(); it != table.end(); ++it)
+        btree.insert(it.key(), it.val());
+    btree.balance();
+    std::chrono::duration<double> setup = std::chrono::steady_clock::now() - start;
+
+    std::cout << std::setw(8) << N << std::setw(16) << std::fixed << std::setprecision(1)
+              << setup.count() * 1e6 << std::setw(16) << time_finds(btree, test_set) / n_tests * 1e9
+              << std::setw(16) << time_finds(table, test_set) / n_tests * 1e9 << std::endl;
+}
+
+int main(int argc, char **argv) {
+    const int n_tests = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    std::cout << std::setw(8) << "entries" << std::setw(16) << "BTree setup[us]" << std::setw(16)
+              << "BTree find[ns]" << std::setw(16) << "static find[ns]" << std::endl;
+    run<16>(n_tests);
+    run<256>(n_tests);
+    run<4096>(n_tests);
+}
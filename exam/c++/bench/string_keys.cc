@@ -0,0 +1,136 @@
+// URL-like string keys with long shared prefixes: StringBTree against a BTree of std::string and
+// std::map. The keys are "https://www.example.com/catalog/<category>/product-<n>.html", inserted
+// in random order; the trees rebalance automatically. See bench.h for the methodology.
+//
+// Operations: insert, find of stored keys (uniform and Zipf) and of missing ones. The memory is
+// the heap requested per key, counted by alloc_counter.h.
+//
+// usage: string_keys.x [--keys 100000] [--warmup 1] [--repetitions 5]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ALLOC_COUNTER_IMPLEMENT
+#include "alloc_counter.h"
+#include "bench.h"
+#include "btree.h"
+#include "string_btree.h"
+
+volatile long sink;
+
+struct string_btree_adapter {
+    static const char *name() { return "StringBTree"; }
+    StringBTree<int> c;
+
+    string_btree_adapter() { c.auto_balance(2); }
+    void insert(const std::string &k, int v) { c.insert(k, v); }
+    bool find(const std::string &k) const { return c.find(k) != c.end(); }
+};
+
+struct btree_adapter {
+    static const char *name() { return "BTree<std::string>"; }
+    BTree<std::string, int> c;
+
+    btree_adapter() { c.auto_balance(2); }
+    void insert(const std::string &k, int v) { c.insert(k, v); }
+    bool find(const std::string &k) const { return c.find(k) != c.end(); }
+};
+
+struct std_map_adapter {
+    static const char *name() { return "std::map<std::string>"; }
+    std::map<std::string, int> c;
+
+    void insert(const std::string &k, int v) { c[k] = v; }
+    bool find(const std::string &k) const { return c.find(k) != c.end(); }
+};
+
+// The URL of the stored key `key` (even) or of a missing one (odd), sharing the same prefixes.
+std::string url(int key) {
+    static const char *const categories[] = {"books", "electronics", "garden", "music", "toys"};
+    char buffer[96];
+    std::snprintf(buffer, sizeof(buffer), "https://www.example.com/catalog/%s/product-%08d.html",
+                  categories[key % 5], key);
+    return buffer;
+}
+
+std::vector<std::string> urls(const std::vector<int> &keys) {
+    std::vector<std::string> result;
+    result.reserve(keys.size());
+    for (int key : keys)
+        result.push_back(url(key));
+    return result;
+}
+
+template <typename Adapter>
+void run(bench::suite &suite,
+         const std::vector<std::string> &keys,
+         const std::vector<std::string> &uniform,
+         const std::vector<std::string> &zipf,
+         const std::vector<std::string> &misses) {
+    const std::size_t size = keys.size();
+    Adapter *a = nullptr;
+
+    suite.run(Adapter::name(), "insert", "urls", size, size,
+              [&]() {
+                  delete a;
+                  a = new Adapter;
+              },
+              [&](std::size_t i) { a->insert(keys[i], i); });
+
+    suite.run(Adapter::name(), "find", "uniform", size, uniform.size(), []() {},
+              [&](std::size_t i) { sink += a->find(uniform[i]); });
+    suite.run(Adapter::name(), "find", "zipf", size, zipf.size(), []() {},
+              [&](std::size_t i) { sink += a->find(zipf[i]); });
+    suite.run(Adapter::name(), "find-miss", "uniform", size, misses.size(), []() {},
+              [&](std::size_t i) { sink += a->find(misses[i]); });
+
+    delete a;
+    alloc_counter::scope filling;
+    Adapter filled;
+    for (std::size_t i = 0; i < size; i++)
+        filled.insert(keys[i], i);
+    std::cout << Adapter::name() << ": " << double(filling.live_bytes()) / size
+              << " bytes per key\n";
+}
+
+int main(int argc, char **argv) {
+    bench::config config;
+    std::size_t size = 100000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--keys") == 0)
+            size = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            config.warmup = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--repetitions") == 0)
+            config.repetitions = std::atoi(argv[i + 1]);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    bench::suite suite{config};
+    std::mt19937 generator{314};
+    std::vector<std::string> keys = urls(bench::shuffled(size, generator));
+    std::vector<std::string> uniform = urls(bench::uniform(size, size, generator));
+    std::vector<std::string> zipf = urls(bench::zipf(size, size, generator));
+
+    std::vector<int> odd = bench::uniform(size, size, generator);
+    for (int &key : odd)
+        key++;
+    std::vector<std::string> misses = urls(odd);
+
+    std::cout << "key length: " << keys[size / 2].size() << " characters\n";
+    run<string_btree_adapter>(suite, keys, uniform, zipf, misses);
+    run<btree_adapter>(suite, keys, uniform, zipf, misses);
+    run<std_map_adapter>(suite, keys, uniform, zipf, misses);
+
+    std::cout << "\n";
+    suite.write_table(std::cout);
+}
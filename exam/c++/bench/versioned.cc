@@ -0,0 +1,114 @@
+// Consistent reports over a tree that keeps being written: a BTree deep-copied through its copy
+// constructor for every report, against a VersionedBTree read through a snapshot. Between two
+// reports, a batch of random overwrites; a report sums all the values. The times are the medians
+// over the reports.
+//
+// usage: versioned.x [--keys 1000000] [--reports 20] [--writes 100000]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "btree.h"
+#include "versioned_btree.h"
+
+volatile long sink;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double median(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+struct result {
+    double report, writes;  // seconds per report and per batch of writes
+};
+
+result deep_copy(const std::vector<int> &keys, const std::vector<int> &updates, int n_reports) {
+    BTree<int, long> tree;
+    tree.auto_balance(2);
+    for (int key : keys)
+        tree.insert(key, key);
+
+    std::vector<double> reports, writes;
+    const std::size_t batch = updates.size() / n_reports;
+    for (int r = 0; r < n_reports; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = r * batch; i < (r + 1) * batch; i++)
+            tree.insert(updates[i], i);
+        writes.push_back(seconds_since(start));
+
+        start = std::chrono::steady_clock::now();
+        BTree<int, long> copy{tree};
+        long sum = 0;
+        for (auto it = copy.cbegin(); it != copy.cend(); ++it)
+            sum += it.val();
+        sink += sum;
+        reports.push_back(seconds_since(start));
+    }
+    return {median(reports), median(writes)};
+}
+
+result snapshot(const std::vector<int> &keys, const std::vector<int> &updates, int n_reports) {
+    VersionedBTree<int, long> tree;
+    for (int key : keys)
+        tree.insert(key, key);
+
+    std::vector<double> reports, writes;
+    const std::size_t batch = updates.size() / n_reports;
+    for (int r = 0; r < n_reports; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = r * batch; i < (r + 1) * batch; i++)
+            tree.insert(updates[i], i);
+        writes.push_back(seconds_since(start));
+
+        start = std::chrono::steady_clock::now();
+        auto view = tree.snapshot();
+        long sum = 0;
+        for (auto it = view.begin(); it != view.end(); ++it)
+            sum += it.val();
+        sink += sum;
+        reports.push_back(seconds_since(start));
+    }
+    return {median(reports), median(writes)};
+}
+
+int main(int argc, char **argv) {
+    std::size_t n_keys = 1000000, n_writes = 100000;
+    int n_reports = 20;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--keys") == 0)
+            n_keys = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--reports") == 0)
+            n_reports = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--writes") == 0)
+            n_writes = std::strtoul(argv[i + 1], nullptr, 10);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 generator{314};
+    std::vector<int> keys = bench::shuffled(n_keys, generator);
+    std::vector<int> updates = bench::uniform(n_keys, n_writes * n_reports, generator);
+
+    std::cout << std::setw(24) << "reports by" << std::setw(16) << "report [ms]" << std::setw(20)
+              << "writes [Mops/s]" << "\n";
+    for (auto run : {&deep_copy, &snapshot}) {
+        result r = run(keys, updates, n_reports);
+        std::cout << std::setw(24) << (run == &deep_copy ? "BTree copy" : "VersionedBTree view")
+                  << std::setw(16) << std::fixed << std::setprecision(2) << r.report * 1e3
+                  << std::setw(20) << n_writes / r.writes / 1e6 << "\n";
+    }
+}
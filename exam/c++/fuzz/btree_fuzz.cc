@@ -0,0 +1,266 @@
+// Differential fuzzer for BTree: the input is decoded into a sequence of operations, applied both
+// to a BTree and to a std::map, and after every operation the two must agree, and the tree must
+// pass its audit() (parent links, key order, cached heights and augmentation, size). The tree is
+// an interval tree, each key standing for an interval of a length derived from it, so that
+// overlapping() and stabbing() are checked too. Height bounds are checked after balance() and,
+// while automatic rebalancing holds, after insertions. Any disagreement prints the operation and
+// aborts.
+//
+// The entry point is libFuzzer's, e.g.
+//     clang++ -std=c++11 -O1 -g -DDEBUG -fsanitize=fuzzer,address -Isrc fuzz/btree_fuzz.cc
+// and driver.cc runs it on random inputs without libFuzzer.
+//
+// Input format: the first byte selects the key range (from 16 to 64k keys, so that both dense
+// and sparse trees are exercised), then every operation takes three bytes: an opcode and a
+// 16-bit key, which also gives the value.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+namespace {
+
+    // Intervals depend on the keys only, so that the values can change through operator[].
+    int interval_end(int key) { return key + 1 + key % 61; }
+    struct end_of_key {
+        int operator()(int key, int) const noexcept { return interval_end(key); }
+    };
+
+    using Tree = BTree<int, int, std::less<int>, btree_stats::none,
+                       btree_augment::interval<int, end_of_key>>;
+    using Map = std::map<int, int>;
+
+    const char *const names[] = {"insert",      "insert",     "erase",     "find",
+                                 "operator[]",  "bounds",     "balance",   "auto_balance",
+                                 "clear",       "copy",       "move",      "assign_sorted",
+                                 "const []",    "iterate",    "overlapping", "balance_step"};
+    const unsigned int n_operations = sizeof(names) / sizeof(names[0]);
+
+    struct state {
+        Tree tree;
+        Map map;
+        std::size_t step{0};
+        // Whether the tree was built only by insertions under the current auto_balance factor,
+        // starting from an empty or perfectly balanced tree, so that the scapegoat bound holds.
+        bool bounded{true};
+    };
+
+    [[noreturn]] void fail(const state &s, unsigned int op, int key, const std::string &what) {
+        std::fprintf(stderr, "btree_fuzz: step %zu, %s(%d): %s\n", s.step, names[op], key,
+                     what.c_str());
+        std::abort();
+    }
+
+    void check(const state &s, unsigned int op, int key) {
+        std::string problem = s.tree.audit();
+        if (not problem.empty())
+            fail(s, op, key, problem);
+        if (s.tree.size() != s.map.size())
+            fail(s, op, key, "size " + std::to_string(s.tree.size()) + " instead of " +
+                                 std::to_string(s.map.size()));
+
+        unsigned int height = s.tree.height();
+        if (height > s.tree.size())
+            fail(s, op, key, "height larger than the size");
+
+        double factor = s.tree.auto_balance();
+        if (s.bounded and factor > 0 and s.tree.size() > 1 and
+            height > factor * std::log2(s.tree.size()) + 2)
+            fail(s, op, key, "height " + std::to_string(height) + " beyond the scapegoat bound");
+    }
+
+    void check_contents(const state &s, unsigned int op, int key) {
+        Tree::const_iterator it = s.tree.cbegin();
+        for (const std::pair<const int, int> &pair : s.map) {
+            if (it == s.tree.cend() or it.key() != pair.first or it.val() != pair.second)
+                fail(s, op, key, "contents differ at key " + std::to_string(pair.first));
+            ++it;
+        }
+        if (it != s.tree.cend())
+            fail(s, op, key, "extra key " + std::to_string(it.key()));
+    }
+
+    void apply(state &s, unsigned int op, int key) {
+        Tree &tree = s.tree;
+        Map &map = s.map;
+        const int value = key * 7 + 1;
+
+        switch (op) {
+            case 0:
+            case 1:
+                tree.insert(key, value);
+                map[key] = value;
+                break;
+
+            case 2: {
+                bool present = map.count(key);
+                try {
+                    std::pair<int, int> erased = tree.erase(key);
+                    if (not present)
+                        fail(s, op, key, "erased a missing key");
+                    if (erased.first != key or erased.second != map[key])
+                        fail(s, op, key, "erase returned the wrong pair");
+                } catch (const KeyNotFound &) {
+                    if (present)
+                        fail(s, op, key, "KeyNotFound for a present key");
+                }
+                map.erase(key);
+                s.bounded = tree.size() == 0;
+                break;
+            }
+
+            case 3: {
+                Tree::iterator it = tree.find(key);
+                Map::iterator expected = map.find(key);
+                if ((it == tree.end()) != (expected == map.end()))
+                    fail(s, op, key, "find disagrees");
+                if (it != tree.end() and (it.key() != key or it.val() != expected->second))
+                    fail(s, op, key, "find returned the wrong pair");
+                break;
+            }
+
+            case 4:
+                tree[key] += value;
+                map[key] += value;
+                break;
+
+            case 5: {
+                Tree::iterator lower = tree.lower_bound(key), upper = tree.upper_bound(key);
+                Map::iterator expected_lower = map.lower_bound(key),
+                              expected_upper = map.upper_bound(key);
+                if ((lower == tree.end()) != (expected_lower == map.end()) or
+                    (lower != tree.end() and lower.key() != expected_lower->first))
+                    fail(s, op, key, "lower_bound disagrees");
+                if ((upper == tree.end()) != (expected_upper == map.end()) or
+                    (upper != tree.end() and upper.key() != expected_upper->first))
+                    fail(s, op, key, "upper_bound disagrees");
+                break;
+            }
+
+            case 6: {
+                tree.balance();
+                unsigned int minimal = std::ceil(std::log2(tree.size() + 1.0));
+                if (tree.height() != minimal)
+                    fail(s, op, key, "height " + std::to_string(tree.height()) +
+                                         " after balance instead of " + std::to_string(minimal));
+                s.bounded = true;
+                break;
+            }
+
+            case 7: {
+                // Mostly off or moderate factors; 1 and below disable it.
+                double factor = (key % 4) ? 1 + (key % 32) / 16.0 : 0;
+                // A pending balance_step() may swap in a tree grown with the former factor.
+                if (factor != tree.auto_balance())
+                    s.bounded = tree.size() == 0 and not tree.rebalancing();
+                tree.auto_balance(factor);
+                break;
+            }
+
+            case 8:
+                // Rare, so that the trees grow.
+                if (key % 16 == 0) {
+                    tree.clear();
+                    map.clear();
+                    s.bounded = true;
+                }
+                break;
+
+            case 9: {
+                Tree copy{tree};
+                if (copy.audit() != "" or copy.height() != tree.height())
+                    fail(s, op, key, "the copy differs");
+                copy.insert(key, value);
+                tree = copy;
+                map[key] = value;
+                break;
+            }
+
+            case 10: {
+                Tree moved{std::move(tree)};
+                if (tree.size() != 0 or tree.height() != 0)
+                    fail(s, op, key, "the moved-from tree is not empty");
+                tree = std::move(moved);
+                break;
+            }
+
+            case 11: {
+                if (key % 4)
+                    break;
+                std::vector<int> keys, values;
+                for (const std::pair<const int, int> &pair : map) {
+                    keys.push_back(pair.first);
+                    values.push_back(pair.second);
+                }
+                tree.assign_sorted(keys.begin(), keys.end(), values.begin());
+                s.bounded = true;
+                break;
+            }
+
+            case 12: {
+                const Tree &const_tree = tree;
+                try {
+                    const int &found = const_tree[key];
+                    if (not map.count(key) or found != map[key])
+                        fail(s, op, key, "const operator[] disagrees");
+                } catch (const KeyNotFound &) {
+                    if (map.count(key))
+                        fail(s, op, key, "KeyNotFound for a present key");
+                }
+                break;
+            }
+
+            case 13:
+                check_contents(s, op, key);
+                break;
+
+            case 14: {
+                // A query of length 0 to 127, or a stabbing one, from the key.
+                int length = value % 129 - 1;
+                std::vector<int> found, expected;
+                Tree::overlap_iterator it =
+                    length < 0 ? tree.stabbing(key) : tree.overlapping(key, key + length);
+                for (; it != tree.end(); ++it)
+                    found.push_back(it.key());
+
+                int hi = length < 0 ? key + 1 : key + length;
+                for (const std::pair<const int, int> &pair : map)
+                    if (pair.first < hi and interval_end(pair.first) > key)
+                        expected.push_back(pair.first);
+                if (found != expected)
+                    fail(s, op, key, "the overlapping intervals differ");
+                break;
+            }
+
+            case 15:
+                tree.balance_step(1 + key % 200);
+                break;
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size) {
+    if (size == 0)
+        return 0;
+
+    const int key_range = 16 << (data[0] % 13);
+    state s;
+
+    for (std::size_t i = 1; i + 3 <= size; i += 3, s.step++) {
+        unsigned int op = data[i] % n_operations;
+        int key = (data[i + 1] | data[i + 2] << 8) % key_range;
+
+        apply(s, op, key);
+        check(s, op, key);
+    }
+
+    check_contents(s, 13, 0);  // reported as "iterate"
+    return 0;
+}
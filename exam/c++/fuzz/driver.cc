@@ -0,0 +1,158 @@
+// Standalone driver for btree_fuzz.cc, for builds without libFuzzer.
+//
+// It replays the input files given on the command line (e.g. crashes found by libFuzzer), or runs
+// the fuzzer on random inputs from a fixed seed. Then it guards against performance regressions:
+// a fixed mix of insert, find and erase is timed on an auto-balanced BTree, and the best
+// throughput of a few repetitions is compared with a baseline saved by an earlier run; the driver
+// fails if it dropped by more than the threshold.
+//
+// usage: fuzz_driver.x [--runs 2000] [--length 3000] [--seed 314] [--ops 1000000]
+//                      [--baseline file] [--save-baseline file] [--threshold 0.2] [inputs...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "btree.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size);
+
+volatile long sink;
+
+void replay(const char *path) {
+    std::ifstream in{path, std::ios::binary};
+    if (not in) {
+        std::cerr << "cannot read " << path << std::endl;
+        std::exit(1);
+    }
+    std::vector<std::uint8_t> data{std::istreambuf_iterator<char>{in},
+                                   std::istreambuf_iterator<char>{}};
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+}
+
+void fuzz(unsigned int runs, std::size_t length, std::mt19937 &generator) {
+    std::uniform_int_distribution<int> byte{0, 255};
+    std::uniform_int_distribution<std::size_t> input_length{1, length};
+    std::vector<std::uint8_t> data;
+
+    for (unsigned int run = 0; run < runs; run++) {
+        data.resize(input_length(generator));
+        for (std::uint8_t &b : data)
+            b = byte(generator);
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+}
+
+// Operations per second on the fixed workload, the best of some repetitions.
+double throughput(std::size_t n_ops) {
+    std::mt19937 generator{42};
+    std::uniform_int_distribution<int> key{0, 1 << 16}, kind{0, 9};
+    std::vector<int> keys(n_ops), kinds(n_ops);
+    for (std::size_t i = 0; i < n_ops; i++) {
+        keys[i] = key(generator);
+        kinds[i] = kind(generator);
+    }
+
+    double best = 0;
+    for (int rep = 0; rep < 5; rep++) {
+        BTree<int, int> tree;
+        tree.auto_balance(2);
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < n_ops; i++) {
+            if (kinds[i] < 3) {
+                tree.insert(keys[i], i);
+            } else if (kinds[i] < 8) {
+                sink += tree.find(keys[i]) != tree.end();
+            } else if (tree.find(keys[i]) != tree.end()) {
+                tree.erase(keys[i]);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::max(best, n_ops / elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    unsigned int runs = 2000;
+    std::size_t length = 3000, n_ops = 1000000;
+    unsigned int seed = 314;
+    double threshold = 0.2;
+    const char *baseline = nullptr, *save_baseline = nullptr;
+    std::vector<const char *> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            inputs.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 == argc) {
+            std::cerr << "missing value for " << argv[i] << std::endl;
+            return 1;
+        }
+
+        if (std::strcmp(argv[i], "--runs") == 0)
+            runs = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--length") == 0)
+            length = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--seed") == 0)
+            seed = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--ops") == 0)
+            n_ops = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--baseline") == 0)
+            baseline = argv[++i];
+        else if (std::strcmp(argv[i], "--save-baseline") == 0)
+            save_baseline = argv[++i];
+        else if (std::strcmp(argv[i], "--threshold") == 0)
+            threshold = std::atof(argv[++i]);
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (not inputs.empty()) {
+        for (const char *path : inputs)
+            replay(path);
+        std::cout << "replayed " << inputs.size() << " inputs" << std::endl;
+        return 0;
+    }
+
+    std::mt19937 generator{seed};
+    fuzz(runs, length, generator);
+    std::cout << runs << " random inputs passed" << std::endl;
+
+    if (n_ops == 0)
+        return 0;
+
+    double ops = throughput(n_ops);
+    std::cout << "throughput: " << ops << " ops/s" << std::endl;
+
+    if (save_baseline)
+        std::ofstream{save_baseline} << ops << "\n";
+
+    if (baseline) {
+        double expected = 0;
+        std::ifstream{baseline} >> expected;
+        if (expected <= 0) {
+            std::cerr << "cannot read the baseline from " << baseline << std::endl;
+            return 1;
+        }
+
+        double change = ops / expected - 1;
+        std::cout << "change from the baseline: " << 100 * change << "%" << std::endl;
+        if (change < -threshold) {
+            std::cerr << "performance regression: more than " << 100 * threshold
+                      << "% slower than the baseline" << std::endl;
+            return 2;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef __ALLOC_COUNTER_H__
+#define __ALLOC_COUNTER_H__
+
+#include <cstddef>
+
+// Allocation counting for tests and benchmarks, by replacing the global operator new and delete.
+// Exactly one translation unit of the program must define ALLOC_COUNTER_IMPLEMENT before
+// including this header, to define the replacements.
+//
+// The counters are per thread, so that a scope measures only what its own thread allocates:
+//
+//     alloc_counter::scope counting;
+//     tree.find(key);
+//     assert(counting.allocations() == 0);
+namespace alloc_counter {
+
+    struct counts {
+        std::size_t allocations;
+        std::size_t deallocations;
+        std::size_t allocated_bytes;
+        std::size_t freed_bytes;
+    };
+
+    // The counters of the calling thread since it started.
+    counts current() noexcept;
+
+    // The counters of the calling thread since construction.
+    class scope {
+        const counts _start;
+
+       public:
+        scope() noexcept : _start(current()) {}
+
+        std::size_t allocations() const noexcept {
+            return current().allocations - _start.allocations;
+        }
+        std::size_t deallocations() const noexcept {
+            return current().deallocations - _start.deallocations;
+        }
+        std::size_t allocated_bytes() const noexcept {
+            return current().allocated_bytes - _start.allocated_bytes;
+        }
+
+        // Bytes allocated and not yet freed, which can be negative if the scope frees older memory.
+        long long live_bytes() const noexcept {
+            counts now = current();
+            return (long long)(now.allocated_bytes - _start.allocated_bytes) -
+                   (long long)(now.freed_bytes - _start.freed_bytes);
+        }
+    };
+}
+
+#ifdef ALLOC_COUNTER_IMPLEMENT
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace alloc_counter {
+
+    // Plain data, so that it is usable from operator new before anything else is initialized.
+    thread_local counts _thread_counts{0, 0, 0, 0};
+
+    // Every block is prefixed by its size, to count the bytes it frees.
+    constexpr std::size_t _header = alignof(std::max_align_t);
+
+    counts current() noexcept { return _thread_counts; }
+}
+
+// Kept out of line: GCC would otherwise see through the size header and warn about it.
+#ifdef __GNUC__
+#define ALLOC_COUNTER_NOINLINE __attribute__((noinline))
+#else
+#define ALLOC_COUNTER_NOINLINE
+#endif
+
+ALLOC_COUNTER_NOINLINE void *operator new(std::size_t size) {
+    char *block = static_cast<char *>(std::malloc(size + alloc_counter::_header));
+    if (not block)
+        throw std::bad_alloc{};
+
+    std::memcpy(block, &size, sizeof(size));
+    alloc_counter::_thread_counts.allocations++;
+    alloc_counter::_thread_counts.allocated_bytes += size;
+    return block + alloc_counter::_header;
+}
+
+ALLOC_COUNTER_NOINLINE void operator delete(void *pointer) noexcept {
+    if (not pointer)
+        return;
+
+    char *block = static_cast<char *>(pointer) - alloc_counter::_header;
+    std::size_t size;
+    std::memcpy(&size, block, sizeof(size));
+    alloc_counter::_thread_counts.deallocations++;
+    alloc_counter::_thread_counts.freed_bytes += size;
+    std::free(block);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+#endif
+
+#endif
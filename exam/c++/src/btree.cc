@@ -1,42 +1,763 @@
 #include "btree.h"
+#include "radix.h"
+#include "rw_lock.h"
 
 #ifdef PYTHON_BUILD
 
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 
 namespace py = pybind11;
 
+// Build with -DBESTBST_STATS to collect the counters returned by `stats()`.
+#ifdef BESTBST_STATS
+using py_stats_policy = btree_stats::counting;
+#else
+using py_stats_policy = btree_stats::none;
+#endif
+
+template <typename K, typename V>
+using PyBTree = BTree<K, V, std::less<K>, py_stats_policy>;
+
+// The trees exposed to Python carry a reader-writer lock, so that Python threads can share them:
+// methods release the GIL and hold the lock, shared by the read-only ones, so that lookups from
+// several threads run in parallel, and exclusive for those that modify the tree. While holding the
+// lock they touch no Python object, so no thread ever waits for the GIL while holding the lock.
+// Trees of Python objects cannot do without the GIL, which then protects them on its own.
+// Every writer bumps `version`, so that the Python iterators, which take the lock at each step,
+// notice a modification of the tree and raise instead of following a stale node.
+template <typename Tree>
+struct shared_tree : Tree {
+    mutable rw_lock lock;
+    std::size_t version = 0;
+};
+
+template <typename Tree>
+using releases_gil =
+    std::integral_constant<bool, not std::is_same<typename Tree::value_type, py::object>::value>;
+
+template <typename Tree, typename F>
+auto with_read_lock(const shared_tree<Tree> &t, F f, std::true_type) -> decltype(f(t)) {
+    py::gil_scoped_release release;
+    rw_lock::read_guard guard{t.lock};
+    return f(t);
+}
+
+template <typename Tree, typename F>
+auto with_read_lock(const shared_tree<Tree> &t, F f, std::false_type) -> decltype(f(t)) {
+    return f(t);
+}
+
+template <typename Tree, typename F>
+auto with_write_lock(shared_tree<Tree> &t, F f, std::true_type) -> decltype(f(t)) {
+    py::gil_scoped_release release;
+    rw_lock::write_guard guard{t.lock};
+    t.version++;
+    return f(t);
+}
+
+template <typename Tree, typename F>
+auto with_write_lock(shared_tree<Tree> &t, F f, std::false_type) -> decltype(f(t)) {
+    t.version++;
+    return f(t);
+}
+
+// Run `f` on the tree as a reader or as a writer.
+template <typename Tree, typename F>
+auto with_read_lock(const shared_tree<Tree> &t, F f) -> decltype(f(t)) {
+    return with_read_lock(t, f, releases_gil<Tree>{});
+}
+
+template <typename Tree, typename F>
+auto with_write_lock(shared_tree<Tree> &t, F f) -> decltype(f(t)) {
+    return with_write_lock(t, f, releases_gil<Tree>{});
+}
+
+// Keys given as Python bytes: pybind11 would turn a std::string back into str, so raw bytes get
+// their own type, converted by the caster below.
+struct bytes_key {
+    std::string data;
+};
+
+inline bool operator<(const bytes_key &a, const bytes_key &b) noexcept {
+    return a.data < b.data;
+}
+
+namespace pybind11 {
+    namespace detail {
+        template <>
+        struct type_caster<bytes_key> {
+            PYBIND11_TYPE_CASTER(bytes_key, _("bytes"));
+
+            bool load(handle src, bool) {
+                char *buffer;
+                Py_ssize_t length;
+
+                if (not PyBytes_Check(src.ptr()) or
+                    PyBytes_AsStringAndSize(src.ptr(), &buffer, &length) != 0)
+                    return false;
+
+                value.data.assign(buffer, length);
+                return true;
+            }
+
+            static handle cast(const bytes_key &src, return_value_policy, handle) {
+                return PyBytes_FromStringAndSize(src.data.data(), src.data.size());
+            }
+        };
+    }
+}
+
+// Names of the supported types, used to build the class names such as `BTree_str_float64`.
+template <typename T>
+struct type_name;
+template <>
+struct type_name<int> {
+    static const char *get() { return "int32"; }
+};
+template <>
+struct type_name<std::int64_t> {
+    static const char *get() { return "int64"; }
+};
+template <>
+struct type_name<double> {
+    static const char *get() { return "float64"; }
+};
+template <>
+struct type_name<std::string> {
+    static const char *get() { return "str"; }
+};
+template <>
+struct type_name<bytes_key> {
+    static const char *get() { return "bytes"; }
+};
+template <>
+struct type_name<py::object> {
+    static const char *get() { return "object"; }
+};
+
+// Adapt the tree iterators to what the Python iterators return: dereferencing gives the key or
+// the (key, value) pair (the tree iterators already give the value), so that Python receives
+// plain objects without a round trip through the iterator class.
+template <typename Tree>
+struct keys_of : Tree::iterator {
+    keys_of(const typename Tree::iterator &it) : Tree::iterator{it} {}
+    const typename Tree::key_type &operator*() const { return this->key(); }
+};
+
+template <typename Tree>
+struct values_of : Tree::iterator {
+    values_of(const typename Tree::iterator &it) : Tree::iterator{it} {}
+};
+
+template <typename Tree>
+struct items_of : Tree::iterator {
+    items_of(const typename Tree::iterator &it) : Tree::iterator{it} {}
+    std::pair<typename Tree::key_type, typename Tree::value_type> operator*() const {
+        return this->pair();
+    }
+};
+
+// Python iterator over [first, last): each step copies the next item out under the read lock,
+// and raises RuntimeError, as dicts do, if the tree was modified since the iterator was created.
+template <template <typename> class View, typename Tree>
+class checked_iterator {
+    using item_type = typename std::decay<decltype(*std::declval<const View<Tree> &>())>::type;
+
+    const shared_tree<Tree> &_tree;
+    View<Tree> _next, _last;
+    std::size_t _version;
+
+   public:
+    checked_iterator(const shared_tree<Tree> &tree,
+                     const typename Tree::iterator &first,
+                     const typename Tree::iterator &last,
+                     std::size_t version)
+        : _tree{tree}, _next{first}, _last{last}, _version{version} {}
+
+    item_type next() {
+        enum { item, done, changed } status;
+        item_type copy;
+        with_read_lock(_tree, [&](const Tree &) {
+            if (_tree.version != _version)
+                status = changed;
+            else if (_next == _last)
+                status = done;
+            else {
+                copy = *_next;
+                ++_next;
+                status = item;
+            }
+        });
+
+        if (status == changed)
+            throw std::runtime_error{"tree changed during iteration"};
+        if (status == done)
+            throw py::stop_iteration();
+        return copy;
+    }
+
+    static void bind(py::handle scope, const char *name) {
+        py::class_<checked_iterator>(scope, name)
+            .def("__iter__", [](py::object self) { return self; })
+            .def("__next__", &checked_iterator::next);
+    }
+};
+
+// Iterate over the (first, last) pair returned by `bounds`, called under the read lock.
+template <template <typename> class View, typename Tree, typename F>
+checked_iterator<View, Tree> view(const shared_tree<Tree> &t, F bounds) {
+    std::size_t version;
+    auto range = with_read_lock(t, [&](const Tree &tree) {
+        version = t.version;
+        return bounds(tree);
+    });
+    return {t, range.first, range.second, version};
+}
+
+// Copy out the pair found by `locate`, if any, so that the Python objects are built after
+// releasing the lock.
+template <typename Tree>
+bool copy_at(const shared_tree<Tree> &t,
+             const typename Tree::key_type &key,
+             std::pair<typename Tree::key_type, typename Tree::value_type> &item,
+             typename Tree::iterator (Tree::*locate)(const typename Tree::key_type &) const) {
+    return with_read_lock(t, [&](const Tree &tree) {
+        auto it = (tree.*locate)(key);
+        if (it == tree.cend())
+            return false;
+        item = it.pair();
+        return true;
+    });
+}
+
+// Iteration over the whole tree, in key order. The iterators keep the tree alive.
+template <typename Tree, typename Class>
+void def_iteration_methods(Class &cls) {
+    using Shared = shared_tree<Tree>;
+
+    checked_iterator<keys_of, Tree>::bind(cls, "key_iterator");
+    checked_iterator<values_of, Tree>::bind(cls, "value_iterator");
+    checked_iterator<items_of, Tree>::bind(cls, "item_iterator");
+
+    cls.def("__iter__", [](const Shared &t) {
+        return view<keys_of>(t, [](const Tree &tree) {
+            return std::make_pair(tree.begin(), tree.end());
+        });
+    }, py::keep_alive<0, 1>());
+    cls.def("keys", [](const Shared &t) {
+        return view<keys_of>(t, [](const Tree &tree) {
+            return std::make_pair(tree.begin(), tree.end());
+        });
+    }, py::keep_alive<0, 1>());
+    cls.def("values", [](const Shared &t) {
+        return view<values_of>(t, [](const Tree &tree) {
+            return std::make_pair(tree.begin(), tree.end());
+        });
+    }, py::keep_alive<0, 1>());
+    cls.def("items", [](const Shared &t) {
+        return view<items_of>(t, [](const Tree &tree) {
+            return std::make_pair(tree.begin(), tree.end());
+        });
+    }, py::keep_alive<0, 1>());
+}
+
+// NaN is neither less nor greater than any number, which the tree takes for equality: a NaN key
+// would find, and overwrite, whichever key it is first compared with. It is refused.
+inline void check_key(double key) {
+    if (std::isnan(key))
+        throw py::value_error("NaN is not a valid key");
+}
+
+template <typename K>
+void check_key(const K &) {}
+
+template <typename K>
+void check_keys(const K *keys, ssize_t n) {
+    for (ssize_t i = 0; i < n; i++)
+        check_key(keys[i]);
+}
+
+// Batch operations on NumPy arrays, for numeric keys and values: contiguous arrays of the right
+// dtype are read in place (others are converted once), and the whole loop runs in C++ without
+// the GIL, holding the tree lock once for the whole batch.
+template <typename T>
+using array_of = py::array_t<T, py::array::c_style | py::array::forcecast>;
+
+template <typename Tree, typename Class>
+void def_batch_methods(Class &, std::false_type) {}
+
+template <typename Tree, typename Class>
+void def_batch_methods(Class &cls, std::true_type) {
+    using K = typename Tree::key_type;
+    using V = typename Tree::value_type;
+    using Shared = shared_tree<Tree>;
+
+    cls.def("insert_many", [](Shared &t, array_of<K> keys, array_of<V> values) {
+        if (keys.size() != values.size())
+            throw py::value_error("keys and values must have the same length");
+
+        const K *key = keys.data();
+        const V *value = values.data();
+        const ssize_t n = keys.size();
+        check_keys(key, n);
+
+        with_write_lock(t, [&](Tree &tree) {
+            for (ssize_t i = 0; i < n; i++)
+                tree.insert(key[i], value[i]);
+        });
+    }, py::arg("keys"), py::arg("values"));
+
+    // Returns the values (0 where missing) and a boolean mask of the keys that were found.
+    cls.def("find_many", [](const Shared &t, array_of<K> keys) {
+        const ssize_t n = keys.size();
+        py::array_t<V> values(n);
+        py::array_t<bool> found(n);
+
+        const K *key = keys.data();
+        check_keys(key, n);
+        V *value = values.mutable_data();
+        bool *mask = found.mutable_data();
+        with_read_lock(t, [&](const Tree &tree) {
+            for (ssize_t i = 0; i < n; i++) {
+                auto it = tree.find(key[i]);
+                mask[i] = it != tree.cend();
+                value[i] = mask[i] ? it.val() : V{};
+            }
+        });
+        return py::make_tuple(values, found);
+    }, py::arg("keys"));
+
+    // Missing keys are skipped; returns how many keys were erased.
+    cls.def("erase_many", [](Shared &t, array_of<K> keys) {
+        const K *key = keys.data();
+        const ssize_t n = keys.size();
+        check_keys(key, n);
+
+        return with_write_lock(t, [&](Tree &tree) {
+            ssize_t erased = 0;
+            for (ssize_t i = 0; i < n; i++) {
+                if (tree.find(key[i]) != tree.cend()) {
+                    tree.erase(key[i]);
+                    erased++;
+                }
+            }
+            return erased;
+        });
+    }, py::arg("keys"));
+}
+
+template <typename Tree>
+using is_numeric =
+    std::integral_constant<bool, std::is_arithmetic<typename Tree::key_type>::value and
+                                     std::is_arithmetic<typename Tree::value_type>::value>;
+
+template <typename Tree, typename Class>
+void def_batch_methods(Class &cls) {
+    def_batch_methods<Tree>(cls, is_numeric<Tree>{});
+}
+
+// Pickling and export of whole trees. Numeric trees travel in the binary format of
+// BTree::serialize, so that a pickle is little more than a copy of the sorted keys and values;
+// the other trees as a (keys, values) pair of lists. In both cases unpickling builds a balanced
+// tree in linear time, without a single insertion.
+template <typename Tree, typename Class>
+void def_transfer_methods(Class &cls, std::true_type) {
+    using K = typename Tree::key_type;
+    using V = typename Tree::value_type;
+    using Shared = shared_tree<Tree>;
+
+    // The sorted keys and values as two new NumPy arrays.
+    cls.def("to_numpy", [](const Shared &t) {
+        for (;;) {
+            std::size_t n = with_read_lock(t, [](const Tree &tree) { return tree.size(); });
+            py::array_t<K> keys(n);
+            py::array_t<V> values(n);
+            K *key = keys.mutable_data();
+            V *value = values.mutable_data();
+
+            // Start over if another thread changed the size in between.
+            if (with_read_lock(t, [&](const Tree &tree) {
+                    if (tree.size() != n)
+                        return false;
+                    tree.export_sorted(key, value);
+                    return true;
+                }))
+                return py::make_tuple(keys, values);
+        }
+    });
+
+    // Replace the content of the tree with sorted, unique keys and their values.
+    cls.def("assign_sorted", [](Shared &t, array_of<K> keys, array_of<V> values) {
+        if (keys.size() != values.size())
+            throw py::value_error("keys and values must have the same length");
+
+        const K *key = keys.data();
+        const V *value = values.data();
+        const ssize_t n = keys.size();
+        with_write_lock(t, [&](Tree &tree) { tree.assign_sorted(key, key + n, value); });
+    }, py::arg("keys"), py::arg("values"));
+
+    cls.def(py::pickle(
+        [](const Shared &t) {
+            for (;;) {
+                std::size_t size =
+                    with_read_lock(t, [](const Tree &tree) { return tree.serialized_size(); });
+                auto state = py::reinterpret_steal<py::bytes>(
+                    PyBytes_FromStringAndSize(nullptr, size));
+                if (not state)
+                    throw py::error_already_set();
+                char *buffer = PyBytes_AsString(state.ptr());
+
+                if (with_read_lock(t, [&](const Tree &tree) {
+                        if (tree.serialized_size() != size)
+                            return false;
+                        tree.serialize(buffer);
+                        return true;
+                    }))
+                    return state;
+            }
+        },
+        [](const py::bytes &state) {
+            char *buffer;
+            Py_ssize_t size;
+            if (PyBytes_AsStringAndSize(state.ptr(), &buffer, &size) != 0)
+                throw py::error_already_set();
+
+            std::unique_ptr<Shared> t{new Shared};
+            with_write_lock(*t, [&](Tree &tree) { tree.deserialize(buffer, size); });
+            return t;
+        }));
+}
+
+template <typename Tree, typename Class>
+void def_transfer_methods(Class &cls, std::false_type) {
+    using K = typename Tree::key_type;
+    using V = typename Tree::value_type;
+    using Shared = shared_tree<Tree>;
+
+    cls.def(py::pickle(
+        [](const Shared &t) {
+            std::vector<K> keys;
+            std::vector<V> values;
+            with_read_lock(t, [&](const Tree &tree) {
+                keys.reserve(tree.size());
+                values.reserve(tree.size());
+                tree.export_sorted(std::back_inserter(keys), std::back_inserter(values));
+            });
+
+            py::list key_list(keys.size()), value_list(values.size());
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                key_list[i] = py::cast(keys[i]);
+                value_list[i] = py::cast(values[i]);
+            }
+            return py::make_tuple(key_list, value_list);
+        },
+        [](const py::tuple &state) {
+            if (state.size() != 2)
+                throw std::invalid_argument{"not a pickled BTree"};
+
+            std::vector<K> keys;
+            std::vector<V> values;
+            for (auto key : state[0])
+                keys.push_back(key.template cast<K>());
+            for (auto value : state[1])
+                values.push_back(value.template cast<V>());
+            if (keys.size() != values.size())
+                throw std::invalid_argument{"not a pickled BTree"};
+
+            std::unique_ptr<Shared> t{new Shared};
+            with_write_lock(*t, [&](Tree &tree) {
+                tree.assign_sorted(keys.begin(), keys.end(), values.begin());
+            });
+            return t;
+        }));
+}
+
+// Bind one BTree instantiation as the class `name`.
+template <typename Tree>
+py::class_<shared_tree<Tree>> bind_btree(py::module &m, const std::string &name) {
+    using K = typename Tree::key_type;
+    using V = typename Tree::value_type;
+    using Shared = shared_tree<Tree>;
+
+    py::class_<Shared> btree(m, name.c_str());
+
+    py::class_<typename Tree::iterator>(btree, "iterator")
+
+        .def(py::init<Shared *>())
+
+        .def("__eq__", &Tree::iterator::operator==);
+
+    btree.def(py::init<>())
+
+        .def("insert", [](Shared &t, const K &key, const V &value) {
+            check_key(key);
+            return with_write_lock(t, [&](Tree &tree) { return tree.insert(key, value); });
+        })
+        .def("print", [](const Shared &t) {
+            std::vector<std::pair<K, V>> items;
+            with_read_lock(t, [&](const Tree &tree) {
+                items.reserve(tree.size());
+                for (auto it = tree.cbegin(); it != tree.cend(); ++it)
+                    items.push_back(it.pair());
+            });
+
+            // Same format as BTree::print, but through Python, which knows how to print any key.
+            py::list pairs;
+            for (const auto &item : items)
+                pairs.append(
+                    py::str("'{}': '{}'").format(py::cast(item.first), py::cast(item.second)));
+            py::print("{" + py::str(", ").attr("join")(pairs).template cast<std::string>() + "}");
+        })
+        .def("size", [](const Shared &t) {
+            return with_read_lock(t, [](const Tree &tree) { return tree.size(); });
+        })
+        .def("clear", [](Shared &t) {
+            return with_write_lock(t, [](Tree &tree) { return tree.clear(); });
+        })
+        .def("erase", [](Shared &t, const K &key) {
+            check_key(key);
+            return with_write_lock(t, [&](Tree &tree) { return tree.erase(key); });
+        })
+        .def("find", [](const Shared &t, const K &key) -> py::object {
+            check_key(key);
+            std::pair<K, V> item;
+            if (not copy_at(t, key, item, &Tree::find))
+                return py::none();
+            return py::make_tuple(item.first, item.second);
+        })
+        .def("is_balanced", [](const Shared &t) {
+            return with_read_lock(t, [](const Tree &tree) { return tree.is_balanced(); });
+        })
+        .def("balance", [](Shared &t) {
+            with_write_lock(t, [](Tree &tree) { tree.balance(); });
+        })
+        .def_property("auto_balance",
+            [](const Shared &t) {
+                return with_read_lock(t, [](const Tree &tree) { return tree.auto_balance(); });
+            },
+            [](Shared &t, double factor) {
+                with_write_lock(t, [&](Tree &tree) { tree.auto_balance(factor); });
+            })
+        .def("height", [](const Shared &t) {
+            return with_read_lock(t, [](const Tree &tree) { return tree.height(); });
+        })
+
+        .def("stats", [](const Shared &t) {
+            btree_stats::snapshot snap =
+                with_read_lock(t, [](const Tree &tree) { return tree.stats(); });
+            py::list visited;
+            for (unsigned int i = 0; i < btree_stats::histogram_buckets; i++)
+                visited.append(snap.visited[i]);
+
+            py::dict d;
+            d["enabled"] = Tree::stats_type::enabled;
+            d["comparisons"] = snap.comparisons;
+            d["lookups"] = snap.lookups;
+            d["nodes_visited"] = snap.nodes_visited;
+            d["mean_visited"] = snap.mean_visited();
+            d["max_visited"] = snap.max_visited;
+            d["visited"] = visited;
+            d["allocations"] = snap.allocations;
+            d["balances"] = snap.balances;
+            d["balance_ns"] = snap.balance_ns;
+            d["height"] = snap.height;
+            return d;
+        })
+        .def("reset_stats", [](Shared &t) { t.reset_stats(); })
+        .def("memory_usage", [](const Shared &t) {
+            btree_memory::usage usage =
+                with_read_lock(t, [](const Tree &tree) { return tree.memory_usage(); });
+            py::dict d;
+            d["object"] = usage.object;
+            d["nodes"] = usage.nodes;
+            d["slack"] = usage.slack;
+            d["heap"] = usage.heap;
+            d["total"] = usage.total();
+            return d;
+        })
+
+        .def_property_readonly_static("key_type", [](py::object) { return type_name<K>::get(); })
+        .def_property_readonly_static("value_type", [](py::object) { return type_name<V>::get(); })
+
+        .def("__len__", [](const Shared &t) {
+            return with_read_lock(t, [](const Tree &tree) { return tree.size(); });
+        })
+
+        // Mapping protocol: unlike operator[], a missing key raises KeyError instead of being
+        // inserted.
+        .def("__getitem__", [](const Shared &t, const K &key) {
+            check_key(key);
+            std::pair<K, V> item;
+            if (not copy_at(t, key, item, &Tree::find))
+                throw py::key_error(py::repr(py::cast(key)).template cast<std::string>());
+            return item.second;
+        })
+        .def("__setitem__", [](Shared &t, const K &key, const V &value) {
+            check_key(key);
+            with_write_lock(t, [&](Tree &tree) { tree.insert(key, value); });
+        })
+        .def("__delitem__", [](Shared &t, const K &key) {
+            check_key(key);
+            with_write_lock(t, [&](Tree &tree) { tree.erase(key); });
+        })
+        .def("__contains__", [](const Shared &t, const K &key) {
+            check_key(key);
+            return with_read_lock(t, [&](const Tree &tree) {
+                return tree.find(key) != tree.cend();
+            });
+        })
+        .def("get", [](const Shared &t, const K &key, py::object default_value) {
+            check_key(key);
+            std::pair<K, V> item;
+            if (not copy_at(t, key, item, &Tree::find))
+                return default_value;
+            return py::cast(item.second);
+        }, py::arg("key"), py::arg("default") = py::none())
+
+        // Range queries over the keys in [low, high): both ends are optional.
+        .def("range", [](const Shared &t, py::object low, py::object high) {
+            bool from_begin = low.is_none(), to_end = high.is_none();
+            K first_key = from_begin ? K{} : low.cast<K>();
+            K last_key = to_end ? K{} : high.cast<K>();
+            check_key(first_key);
+            check_key(last_key);
+
+            return view<items_of>(t, [&](const Tree &tree) {
+                return std::make_pair(from_begin ? tree.begin() : tree.lower_bound(first_key),
+                                      to_end ? tree.end() : tree.lower_bound(last_key));
+            });
+        }, py::arg("low") = py::none(), py::arg("high") = py::none(), py::keep_alive<0, 1>())
+        .def("lower_bound", [](const Shared &t, const K &key) -> py::object {
+            check_key(key);
+            std::pair<K, V> item;
+            if (not copy_at(t, key, item, &Tree::lower_bound))
+                return py::none();
+            return py::make_tuple(item.first, item.second);
+        })
+        .def("upper_bound", [](const Shared &t, const K &key) -> py::object {
+            check_key(key);
+            std::pair<K, V> item;
+            if (not copy_at(t, key, item, &Tree::upper_bound))
+                return py::none();
+            return py::make_tuple(item.first, item.second);
+        });
+
+    def_iteration_methods<Tree>(btree);
+    def_batch_methods<Tree>(btree);
+    def_transfer_methods<Tree>(btree, is_numeric<Tree>{});
+
+    return btree;
+}
+
+// One class for each supported value type.
+template <typename K>
+void bind_btrees(py::module &m) {
+    const std::string prefix = std::string{"BTree_"} + type_name<K>::get() + "_";
+
+    bind_btree<PyBTree<K, std::int64_t>>(m, prefix + type_name<std::int64_t>::get());
+    bind_btree<PyBTree<K, double>>(m, prefix + type_name<double>::get());
+    bind_btree<PyBTree<K, py::object>>(m, prefix + type_name<py::object>::get());
+}
+
+// Normalize the key_type/value_type arguments of make_tree: a Python type (int, float, str,
+// bytes, object) or the name of a type ("int32", "int64", "float64", ...).
+std::string type_tag(py::object type) {
+    std::string name = py::isinstance<py::str>(type) ? type.cast<std::string>()
+                                                     : type.attr("__name__").cast<std::string>();
+    if (name == "int")
+        return "int64";
+    if (name == "float" or name == "double")
+        return "float64";
+    return name;
+}
+
 PYBIND11_MODULE(bestbst, m) {
-    py::class_<BTree<int, int>::iterator>(m, "iterator")
+    py::register_exception_translator([](std::exception_ptr p) {
+        try {
+            if (p)
+                std::rethrow_exception(p);
+        } catch (const KeyNotFound &e) {
+            const char *message = e.message.empty() ? "key not found" : e.message.c_str();
+            PyErr_SetString(PyExc_KeyError, message);
+        }
+    });
+
+    // The original int -> int tree, also named after its types like the generic ones.
+    auto btree = bind_btree<PyBTree<int, int>>(m, "BTree");
+    m.attr("BTree_int32_int32") = btree;
+    m.attr("iterator") = btree.attr("iterator");
 
-        .def(py::init<BTree<int, int> *>())
+    bind_btrees<std::int64_t>(m);
+    bind_btrees<double>(m);
+    bind_btrees<std::string>(m);
+    bind_btrees<bytes_key>(m);
 
-        .def("__eq__", &BTree<int, int>::iterator::operator==);
+    m.def("make_tree", [](py::object key_type, py::object value_type) {
+        std::string name = "BTree_";
+        name += key_type.is_none() ? "int32" : type_tag(key_type);
+        name += "_";
+        name += value_type.is_none() ? "int32" : type_tag(value_type);
 
-    py::class_<BTree<int, int>>(m, "BTree")
+        py::module bestbst = py::module::import("bestbst");
+        if (not py::hasattr(bestbst, name.c_str()))
+            throw py::type_error("unsupported key and value types: " + name);
+        return bestbst.attr(name.c_str())();
+    }, py::arg("key_type") = py::none(), py::arg("value_type") = py::none(),
+       "Create a tree specialized for the given key and value types (int32 -> int32 by default).");
 
-        .def(py::init<>())
+    using Radix = RadixTree<int, int>;
+    using SharedRadix = shared_tree<Radix>;
 
-        .def("insert", py::overload_cast<const int &, const int &>(&BTree<int, int>::insert))
-        .def("print", &BTree<int, int>::print)
-        .def("size", &BTree<int, int>::size)
-        .def("clear", &BTree<int, int>::clear)
-        .def("erase", &BTree<int, int>::erase)
-        .def("find", &BTree<int, int>::find)
-        .def("is_balanced", &BTree<int, int>::is_balanced)
-        .def("balance", &BTree<int, int>::balance)
-        .def("height", [](const BTree<int, int> &t) {
-                return t.height();
+    py::class_<SharedRadix> radix(m, "RadixTree");
+
+    radix.def(py::init<>())
+
+        .def("insert", [](SharedRadix &t, int key, int value) {
+            return with_write_lock(t, [&](Radix &tree) { return tree.insert(key, value); });
+        })
+        .def("print", [](const SharedRadix &t) {
+            with_read_lock(t, [](const Radix &tree) { tree.print(); });
+        })
+        .def("size", [](const SharedRadix &t) {
+            return with_read_lock(t, [](const Radix &tree) { return tree.size(); });
+        })
+        .def("clear", [](SharedRadix &t) {
+            return with_write_lock(t, [](Radix &tree) { return tree.clear(); });
+        })
+        .def("erase", [](SharedRadix &t, int key) {
+            return with_write_lock(t, [&](Radix &tree) { return tree.erase(key); });
+        })
+        .def("find", [](const SharedRadix &t, int key) -> py::object {
+            std::pair<int, int> item;
+            if (not copy_at(t, key, item, &Radix::find))
+                return py::none();
+            return py::make_tuple(item.first, item.second);
+        })
+        .def("lower_bound", [](const SharedRadix &t, int key) -> py::object {
+            std::pair<int, int> item;
+            if (not copy_at(t, key, item, &Radix::lower_bound))
+                return py::none();
+            return py::make_tuple(item.first, item.second);
         })
 
-        .def("__len__", &BTree<int, int>::size)
+        .def("__len__", [](const SharedRadix &t) {
+            return with_read_lock(t, [](const Radix &tree) { return tree.size(); });
+        });
 
-        /*
-        .def("__iter__", [](BTree<int, int> &t) {
-            return py::make_key_iterator( t.begin(), t.end());
-        }, py::keep_alive<0, 1>())
-        */
-        ;
+    def_iteration_methods<Radix>(radix);
+    def_batch_methods<Radix>(radix);
 }
 
 #endif
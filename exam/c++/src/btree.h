@@ -1,12 +1,23 @@
 #ifndef __BTREE_H__
 #define __BTREE_H__
 
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>     // std::memcpy
 #include <functional>  // std::less
 #include <iterator>    // to derive from std::iterator
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#include "btree_augment.h"
+#include "btree_memory.h"
+#include "btree_stats.h"
 
 // #define VERBOSE
 
@@ -22,70 +33,210 @@
     } while (false)
 #endif
 
+// Hint that the memory at `address` will be read soon.
+#if defined(__GNUC__)
+#define BTREE_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define BTREE_PREFETCH(address) \
+    do {                        \
+    } while (false)
+#endif
+
 struct KeyNotFound {
     std::string message;
 };
 
-template <typename K, typename V, typename cmp = std::less<K>>
+template <typename K,
+          typename V,
+          typename cmp = std::less<K>,
+          typename stats_policy = btree_stats::none,
+          typename augment = btree_augment::none>
 class BTree {
     class Node;
 
     std::unique_ptr<Node> root;
     unsigned int _size{0};
     const cmp comparator;
+    stats_policy _stats;
+
+    // Automatic rebalancing: an insertion deeper than `_balance_factor * log2(size)` rebuilds the
+    // subtree of its scapegoat, the lowest ancestor whose heavier child holds more than
+    // `_weight_limit` of its nodes. Disabled while `_balance_factor` is zero.
+    double _balance_factor{0};
+    double _weight_limit{0};
 
     bool _compare(const K &key1, const K &key2) const noexcept {
+        _stats.comparison();
         return not comparator(key1, key2);
     }
 
     bool _equal_compare(const K &key1, const K &key2) const noexcept {
+        _stats.comparison(2);
         return (not comparator(key1, key2) and not comparator(key2, key1));
     }
 
-    Node *_traverse_to_closest(const K &key) const noexcept;
+    std::unique_ptr<Node> _make_node(const K &key, const V &value) const {
+        _stats.allocation();
+        return std::unique_ptr<Node>{new Node(key, value)};
+    }
+
+    // If `depth` is given, it receives the number of nodes visited to reach the returned node.
+    Node *_traverse_to_closest(const K &key, unsigned int *depth = nullptr) const noexcept;
 
     // For our convenience, we create a find version that returns a Node*, which can be used in
     // many other methods.
     Node *_find(const K &key) const noexcept;
 
+    Node *_bound(const K &key, bool strict) const noexcept;
+
     bool insert(std::unique_ptr<Node> node_to_insert) noexcept;
 
-    unsigned int height(Node *root) const noexcept;
+    // Link a new node below `parent_node`, the closest one found at `depth` by
+    // _traverse_to_closest, then update the heights and rebalance if needed.
+    void _attach(Node *parent_node,
+                 std::unique_ptr<Node> node_to_insert,
+                 unsigned int depth) noexcept;
+
+    // Refresh the cached heights and augmentation from `node` up to the root, stopping as soon as
+    // a node is unchanged, but not before `stale`, an ancestor whose cached fields were copied
+    // from another node.
+    void _update_heights(Node *node, const Node *stale = nullptr) noexcept {
+        bool below_stale = stale != nullptr;
+        for (; node; node = node->_parent) {
+            if (node == stale)
+                below_stale = false;
+            if (not node->update() and not below_stale)
+                break;
+        }
+    }
+
+    // Helpers to rebuild a subtree as a perfectly balanced one, re-linking the existing nodes.
+    std::unique_ptr<Node> &_owner(Node *node) noexcept;
+    unsigned int _subtree_size(const Node *node) const noexcept;
+    // `size` is the number of nodes in the subtree, to allocate the scratch space only once.
+    void _rebuild(std::unique_ptr<Node> &subtree, unsigned int size) noexcept;
+    std::unique_ptr<Node> _build(std::vector<std::unique_ptr<Node>> &nodes,
+                                 std::size_t first,
+                                 std::size_t last,
+                                 Node *parent) noexcept;
+    void _rebalance_from(Node *inserted) noexcept;
+
+    // Replace the whole tree with the given nodes, which must be in strictly increasing key order.
+    void _assign(std::vector<std::unique_ptr<Node>> &nodes);
+
+    // Header of the binary format written by serialize(): the keys follow, then the values, both
+    // in key order and in the native byte order.
+    struct _serial_header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t key_size;
+        std::uint32_t value_size;
+        std::uint64_t count;
+    };
 
-    void insert_recursive(Node *current, Node *parent) noexcept {
-        std::unique_ptr<Node> temp{new Node(current->key(), current->val())};
-        temp->_parent = parent;
-        insert(std::move(temp));
+    // Deep copy of a subtree, with the same shape.
+    std::unique_ptr<Node> _clone(const Node *node) const;
 
-        if (current->left)
-            insert_recursive(current->left.get(), current);
-        if (current->right)
-            insert_recursive(current->right.get(), current);
+    // Progress of an incremental rebuild by balance_step(), if one is running.
+    struct _rebuild_state;
+    std::unique_ptr<_rebuild_state> _rebuilding;
+
+    // Remember a key written while balance_step() builds the new tree, to replay it there.
+    void _touch(const K &key) noexcept {
+        if (_rebuilding and _rebuilding->current != _rebuild_state::phase::freeing)
+            _rebuilding->written.push_back(key);
     }
 
    public:
+    using key_type = K;
+    using value_type = V;
+    using stats_type = stats_policy;
+    using augment_type = augment;
+
     BTree(cmp op = cmp{}) noexcept : comparator{op} {};
 
     const unsigned int &size() const noexcept { return _size; }
 
     bool insert(const K &key, const V &value) noexcept {
-        return insert(std::unique_ptr<Node>{new Node(key, value)});
+        return insert(_make_node(key, value));
     };
 
     void print() const noexcept;
     bool clear() noexcept;
     void balance() noexcept;
 
-    unsigned int height() const noexcept {
-        if (not root)
-            return 0;
-        return height(root.get());
+    // Incremental balance(), for trees too large to rebuild without stalling their users. Every
+    // call does at most `budget` units of work, each copying, linking or freeing one node or
+    // replaying one write, and returns whether the rebuild is complete; the tree can be used
+    // normally between the calls. A balanced copy is built aside, brought up to date with the
+    // keys written meanwhile, swapped in at once and the old nodes freed, so it costs the memory
+    // of a second tree while it runs. The swap moves the pairs to new nodes, invalidating
+    // iterators and references, and values changed through an iterator since the rebuild
+    // started are lost; those set with insert() or operator[] are not.
+    bool balance_step(std::size_t budget);
+    // The same, working for about `budget` of time.
+    bool balance_step(std::chrono::microseconds budget);
+    bool rebalancing() const noexcept { return bool(_rebuilding); }
+
+    // Keep the height within `factor * log2(size)` by rebuilding only the offending subtree after
+    // an insertion, scapegoat-tree style; `factor` must be greater than 1, and 0 disables it.
+    void auto_balance(double factor) noexcept {
+        _balance_factor = factor > 1 ? factor : 0;
+        _weight_limit = factor > 1 ? std::pow(2.0, -1.0 / factor) : 0;
     }
+    double auto_balance() const noexcept { return _balance_factor; }
+
+    // Heights are cached in the nodes and kept up to date by every modification.
+    unsigned int height() const noexcept { return root ? root->_height : 0; }
 
     // unsigned int height() const { return height() <= std::ceil(std::log2(_size)); }
     bool is_balanced() const noexcept { return height() <= std::ceil(std::log2(_size)); };
     // bool is_balanced() const { return height(root.get()); };
 
+    // Snapshot of the counters collected by the statistics policy. With the default
+    // `btree_stats::none` policy only the height is filled in.
+    btree_stats::snapshot stats() const noexcept {
+        btree_stats::snapshot snap;
+        snap.height = height();
+        _stats.fill(snap);
+        return snap;
+    }
+    void reset_stats() noexcept { _stats.reset(); }
+
+    // Bytes used by the tree: the nodes, an estimate of the allocator overhead on them, and the
+    // heap owned by the keys and the values, measured through `heap_usage` (see btree_memory.h).
+    // During a balance_step() rebuild, this includes the second tree.
+    btree_memory::usage memory_usage() const noexcept;
+
+    // Replace the content of the tree with the pairs (keys[i], values[i]), with the keys given in
+    // strictly increasing order, building a perfectly balanced tree in linear time. Throws
+    // std::invalid_argument, leaving the tree untouched, if the keys are not sorted.
+    template <typename KeyIt, typename ValueIt>
+    void assign_sorted(KeyIt first_key, KeyIt last_key, ValueIt first_value) {
+        std::vector<std::unique_ptr<Node>> nodes;
+        for (; first_key != last_key; ++first_key, ++first_value)
+            nodes.push_back(_make_node(*first_key, *first_value));
+        _assign(nodes);
+    }
+
+    // Write the keys and the values in key order to `keys` and `values`.
+    template <typename KeyOut, typename ValueOut>
+    void export_sorted(KeyOut keys, ValueOut values) const {
+        for (auto it = cbegin(); it != cend(); ++it) {
+            *keys++ = it.key();
+            *values++ = it.val();
+        }
+    }
+
+    // Compact binary serialization, for trivially copyable keys and values: serialize() fills
+    // `serialized_size()` bytes at `out`, deserialize() replaces the tree with the one read from a
+    // buffer written by serialize(), throwing std::invalid_argument if it is malformed.
+    std::size_t serialized_size() const noexcept {
+        return sizeof(_serial_header) + _size * (sizeof(K) + sizeof(V));
+    }
+    void serialize(char *out) const noexcept;
+    void deserialize(const char *in, std::size_t size);
+
     class iterator;
     class const_iterator;
     iterator begin() noexcept { return iterator{this}; }
@@ -97,25 +248,74 @@ class BTree {
     const_iterator cend() const noexcept { return const_iterator{this, nullptr}; }
 
     iterator find(const K &key) const noexcept { return iterator{this, _find(key)}; }
+
+    // Insert the pair only if `key` is missing, returning its node and whether it was inserted;
+    // a present key keeps its value. Nodes are never moved, so the iterator stays valid until
+    // the key is erased.
+    std::pair<iterator, bool> try_insert(const K &key, const V &value) noexcept;
+
+    // find() with a three-way comparison in place of the comparator: `probe(key)` is negative if
+    // the key searched for is smaller than `key`, positive if it is greater and zero if they are
+    // equal. The probe is called on the nodes of a single descent from the root, in order, so it
+    // can carry state from one call to the next (see string_btree.h).
+    template <typename Probe>
+    iterator find_with(Probe &&probe) const noexcept;
+
+    // Batched find(): results[i] = find(first[i]) for every key in [first, last), with random
+    // access iterators. Up to `width` lookups run at once, as state machines stepped in turn:
+    // each one prefetches its next node and yields to the others before reading it, so that the
+    // cache misses of different lookups overlap. It pays off on trees much larger than the caches.
+    template <unsigned int width = 16, typename KeyIt, typename ResultIt>
+    void find_interleaved(KeyIt first, KeyIt last, ResultIt results) const noexcept;
+
+    // Interval queries, for trees augmented with btree_augment::interval, where every node holds
+    // the interval [key, end). overlapping(lo, hi) iterates, in key order, over the intervals
+    // with key < hi and end > lo, i.e. overlapping [lo, hi) if it is not empty, and
+    // stabbing(point) over those that contain `point`; both end at end(). Subtrees ending before
+    // the query are skipped, so finding k intervals visits O((k + 1) log n) nodes in a balanced
+    // tree.
+    class overlap_iterator;
+    overlap_iterator overlapping(const K &lo, const K &hi) const noexcept {
+        return overlap_iterator{this, lo, hi, false};
+    }
+    overlap_iterator stabbing(const K &point) const noexcept {
+        return overlap_iterator{this, point, point, true};
+    }
+
     std::pair<K, V> erase(const K &key);
 
-    // Provide two different versions to access the value: rw and ro.
-    V &operator[](const K &key) noexcept;
-    const V &operator[](const K &key) const noexcept { return operator[](key); }
+    // First node whose key is not less (lower_bound) or is greater (upper_bound) than `key`;
+    // [lower_bound(a), lower_bound(b)) iterates over the keys in [a, b).
+    iterator lower_bound(const K &key) const noexcept { return iterator{this, _bound(key, false)}; }
+    iterator upper_bound(const K &key) const noexcept { return iterator{this, _bound(key, true)}; }
+
+    // Provide two different versions to access the value: rw and ro. The rw version inserts a
+    // default value for a missing key; the ro one cannot, and throws KeyNotFound instead.
+    V &operator[](const K &key) noexcept { return try_insert(key, V{}).first.val(); }
+    const V &operator[](const K &key) const;
 
     /* copy ctor */
-    BTree(const BTree &other) noexcept : _size{0}, comparator{other.comparator} {
-        insert_recursive(other.root.get(), nullptr);
+    BTree(const BTree &other)
+        : _size{other._size},
+          comparator{other.comparator},
+          _balance_factor{other._balance_factor},
+          _weight_limit{other._weight_limit} {
+        root = _clone(other.root.get());
     }
 
     /* move ctor */
     BTree(BTree &&other) noexcept
-        : root{std::move(other.root)}, _size{other._size}, comparator{other.comparator} {
+        : root{std::move(other.root)},
+          _size{other._size},
+          comparator{other.comparator},
+          _balance_factor{other._balance_factor},
+          _weight_limit{other._weight_limit},
+          _rebuilding{std::move(other._rebuilding)} {
         other._size = 0;
     }
 
     /* copy assignment operator */
-    BTree &operator=(const BTree &other) noexcept {
+    BTree &operator=(const BTree &other) {
         BTree tmp(other);        // re-use copy-constructor
         *this = std::move(tmp);  // re-use move-assignment
         return *this;
@@ -127,8 +327,11 @@ class BTree {
             return *this;
 
         root = std::move(other.root);
+        _rebuilding = std::move(other._rebuilding);
         _size = std::move(other._size);
         other._size = 0;
+        _balance_factor = other._balance_factor;
+        _weight_limit = other._weight_limit;
 
         return *this;
     }
@@ -137,27 +340,58 @@ class BTree {
     unsigned int traversal_size() const noexcept { return (root) ? root->traverse() : 0; };
     Node *_find_public(const K key) const noexcept { return _find(key); }
     Node *get_root() const noexcept { return root.get(); }
+
+    // Height recomputed by visiting every node, to validate the cached one.
+    unsigned int audit_height() const noexcept;
+
+    // Check the invariants of the tree: parent links, strictly increasing keys in order, cached
+    // heights and size. Returns a description of the first violation found, or an empty string.
+    std::string audit() const;
 #endif
 };
 
-template <typename K, typename V, typename cmp>
-class BTree<K, V, cmp>::Node {
+template <typename K, typename V, typename cmp, typename stats_policy, typename augment>
+class BTree<K, V, cmp, stats_policy, augment>::Node : public augment {
    public:
     const K _key;
     V _val;
     Node *_parent;
     std::unique_ptr<BTree::Node> left, right;
 
+    // Height of the subtree rooted in this node; a leaf has height 1.
+    unsigned int _height{1};
+
     // Node(std::pair<K, V> pair, Node *parent = nullptr) : _pair{pair}, _parent{parent} {};
     Node(const K &key, const V &val, Node *parent = nullptr) noexcept
-        : _key{key}, _val{val}, _parent{parent} {};
+        : _key{key}, _val{val}, _parent{parent} {
+        augment::update(*this);
+    };
+
+    // Recompute the height and the augmentation from the children, returning whether either
+    // changed.
+    bool update() noexcept {
+        bool changed = augment::update(*this);
+        unsigned int new_height =
+            std::max(left ? left->_height : 0, right ? right->_height : 0) + 1;
+        if (new_height == _height)
+            return changed;
+
+        _height = new_height;
+        return true;
+    }
+
+    // Take the cached fields of `other`, a node of the same shape.
+    void copy_cached(const Node &other) noexcept {
+        _height = other._height;
+        static_cast<augment &>(*this) = other;
+    }
 
     const std::pair<K, V> pair() const noexcept { return std::make_pair(_key, _val); }
     const K &key() const noexcept { return _key; }
 
     // rw and ro versions.
     V &val() noexcept { return _val; }
-    const V &val() const noexcept { return val(); }
+    const V &val() const noexcept { return _val; }
 
 #ifdef DEBUG
     unsigned int traverse() const noexcept {
@@ -185,8 +419,56 @@ class BTree<K, V, cmp>::Node {
     }
 };
 
-template <typename K, typename V, typename cmp>
-class BTree<K, V, cmp>::iterator : public std::iterator<std::forward_iterator_tag, K> {
+// The nodes are copied in key order, then linked into a balanced tree as they come, like a
+// recursive build would, with an explicit stack; the keys written meanwhile are then replayed on
+// it, looking up their current value in the live tree, and the trees are swapped. No container
+// grows with the tree, so that the steps stay short: freeing a large block can make the
+// allocator coalesce all the small ones freed before.
+template <typename K, typename V, typename cmp, typename stats_policy, typename augment>
+struct BTree<K, V, cmp, stats_policy, augment>::_rebuild_state {
+    enum class phase { copying, linking, replaying, freeing };
+    phase current{phase::copying};
+
+    // The tree being built, which holds the old nodes after the swap.
+    BTree shadow;
+
+    // The copies in key order, chained through their right child.
+    std::unique_ptr<Node> head;
+    Node *tail{nullptr};
+    std::size_t copied{0};
+    std::size_t copied_heap{0};  // owned by the keys and values of the copies
+
+    // A subtree of `size` nodes to build: `step` 0 builds its left subtree, 1 takes its root
+    // from the chain and builds its right subtree, 2 links it. `built` is the last one done.
+    struct frame {
+        std::size_t size;
+        unsigned int step;
+        std::unique_ptr<Node> root;
+    };
+    std::vector<frame> stack;
+    std::unique_ptr<Node> built;
+
+    std::vector<K> written;
+    std::size_t replayed{0};
+
+    explicit _rebuild_state(const cmp &comparator) : shadow{comparator} {}
+
+    // The nodes held on the side: the copies, then the new tree, then the old one being freed.
+    std::size_t nodes() const noexcept {
+        return current == phase::copying or current == phase::linking ? copied : shadow._size;
+    }
+
+    // The chain is as deep as it is long: free it without recursion.
+    ~_rebuild_state() {
+        while (head)
+            head = std::move(head->right);
+    }
+};
+
+template <typename K, typename V, typename cmp, typename stats_policy, typename augment>
+class BTree<K, V, cmp, stats_policy, augment>::iterator
+    : public std::iterator<std::forward_iterator_tag, K> {
+   protected:
     const BTree *_tree_ref;
     Node *_current;
 
@@ -232,8 +514,9 @@ class BTree<K, V, cmp>::iterator : public std::iterator<std::forward_iterator_ta
     bool operator!=(const iterator &other) const noexcept { return not(*this == other); }
 };
 
-template <typename K, typename V, typename cmp>
-class BTree<K, V, cmp>::const_iterator : public BTree<K, V, cmp>::iterator {
+template <typename K, typename V, typename cmp, typename stats_policy, typename augment>
+class BTree<K, V, cmp, stats_policy, augment>::const_iterator
+    : public BTree<K, V, cmp, stats_policy, augment>::iterator {
    public:
     // using iterator::iterator;
 
@@ -241,7 +524,88 @@ class BTree<K, V, cmp>::const_iterator : public BTree<K, V, cmp>::iterator {
     explicit const_iterator(const BTree *tree_ref, Node *current) noexcept
         : iterator{tree_ref, current} {}
 
-    const V &operator*() const noexcept { return BTree<K, V, cmp>::iterator::operator*(); }
+    const V &operator*() const noexcept {
+        return BTree<K, V, cmp, stats_policy, augment>::iterator::operator*();
+    }
+};
+
+template <typename K, typename V, typename cmp, typename stats_policy, typename augment>
+class BTree<K, V, cmp, stats_policy, augment>::overlap_iterator
+    : public BTree<K, V, cmp, stats_policy, augment>::iterator {
+    using base = typename BTree<K, V, cmp, stats_policy, augment>::iterator;
+    using base::_tree_ref;
+    using base::_current;
+
+    // The intervals [key, end) wanted end after `_lo` and start before `_hi`, or at `_hi` too
+    // when `_closed`.
+    K _lo, _hi;
+    bool _closed;
+
+    bool _ends_after_lo(const K &end) const noexcept { return _tree_ref->comparator(_lo, end); }
+    bool _starts_before_hi(const Node *node) const noexcept {
+        return _closed ? not _tree_ref->comparator(_hi, node->key())
+                       : _tree_ref->comparator(node->key(), _hi);
+    }
+
+    // The first interval of the subtree, in key order, that ends after `_lo`, if it starts
+    // before `_hi`. The subtree maxima lead straight to it.
+    Node *_first(Node *node) const noexcept {
+        if (not node or not _ends_after_lo(node->max_end()))
+            return nullptr;
+
+        while (true) {
+            if (node->left and _ends_after_lo(node->left->max_end()))
+                node = node->left.get();
+            else if (_ends_after_lo(augment::end(*node)))
+                break;
+            else
+                node = node->right.get();
+        }
+        return _starts_before_hi(node) ? node : nullptr;
+    }
+
+   public:
+    overlap_iterator(const BTree *tree_ref, const K &lo, const K &hi, bool closed) noexcept
+        : base{tree_ref, nullptr}, _lo{lo}, _hi{hi}, _closed{closed} {
+        _current = _first(tree_ref->root.get());
+    }
+
+    // The next interval is the first one in the right subtree or, climbing up, in an ancestor
+    // reached from its left subtree or in its right subtree.
+    overlap_iterator &operator++() noexcept {
+        if (Node *next = _first(_current->right.get())) {
+            _current = next;
+            return *this;
+        }
+
+        Node *child = _current;
+        Node *parent = child->_parent;
+        while (parent) {
+            if (parent->left.get() == child) {
+                if (not _starts_before_hi(parent))
+                    break;
+                if (_ends_after_lo(augment::end(*parent))) {
+                    _current = parent;
+                    return *this;
+                }
+                if (Node *next = _first(parent->right.get())) {
+                    _current = next;
+                    return *this;
+                }
+            }
+            child = parent;
+            parent = parent->_parent;
+        }
+
+        _current = nullptr;
+        return *this;
+    }
+
+    overlap_iterator operator++(int) noexcept {
+        overlap_iterator it{*this};
+        ++(*this);
+        return it;
+    }
 };
 
 #include "btree.hcc"
@@ -0,0 +1,68 @@
+#ifndef __BTREE_AUGMENT_H__
+#define __BTREE_AUGMENT_H__
+
+#include <functional>
+
+// Augmentation policies for BTree, selected with its fifth template argument: a value cached in
+// every node and computed from the node and its children, kept up to date, like the heights, by
+// insert, erase and the rebuilds of balance() and automatic rebalancing.
+//
+// A policy is a base class of the nodes, so it holds the cached fields, with a member
+//     template <typename Node> bool update(const Node &node) noexcept;
+// which recomputes them for `node` (this very object), from its key, value and children, and
+// returns whether they changed. The default `btree_augment::none` is empty and costs nothing.
+//
+// When the cached fields depend on the values, change the values with insert(), which updates
+// them, not through operator[] or an iterator.
+namespace btree_augment {
+
+    class none {
+       public:
+        template <typename Node>
+        bool update(const Node &) noexcept {
+            return false;
+        }
+    };
+
+    // The end of an interval stored as the value, keyed by its start.
+    struct value_is_end {
+        template <typename K, typename V>
+        const V &operator()(const K &, const V &value) const noexcept {
+            return value;
+        }
+    };
+
+    // Interval trees: every node stores an interval [key, end), with `end_of(key, value)` giving
+    // its end, and caches the largest end in its subtree, so that BTree::overlapping() skips the
+    // subtrees that end before the query starts.
+    template <typename K, typename end_of = value_is_end, typename cmp = std::less<K>>
+    class interval {
+        K _max_end{};
+
+       public:
+        const K &max_end() const noexcept { return _max_end; }
+
+        // The end of the interval of `node`.
+        template <typename Node>
+        static K end(const Node &node) noexcept {
+            return end_of{}(node.key(), node.val());
+        }
+
+        template <typename Node>
+        bool update(const Node &node) noexcept {
+            const cmp less{};
+            K largest = end(node);
+            if (node.left and less(largest, node.left->max_end()))
+                largest = node.left->max_end();
+            if (node.right and less(largest, node.right->max_end()))
+                largest = node.right->max_end();
+
+            if (not less(largest, _max_end) and not less(_max_end, largest))
+                return false;
+            _max_end = largest;
+            return true;
+        }
+    };
+}
+
+#endif
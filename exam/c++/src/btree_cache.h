@@ -0,0 +1,280 @@
+#ifndef __BTREE_CACHE_H__
+#define __BTREE_CACHE_H__
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "btree.h"
+
+// Bounded cache on a BTree, evicting the least recently used entry once full and, optionally,
+// entries older than a time to live.
+//
+// The bookkeeping is intrusive: every entry, stored in its node, is linked in a list by use and
+// in a list by expiry time, so get() finds a key and bumps it with a single descent, and the
+// entry to evict or to expire is found in O(1). Since all the entries have the same time to
+// live, from their last put(), the expiry list is kept in order just by appending to it. Expired
+// entries are dropped a few at a time by put() and get(), so the cost is amortized, or all at
+// once by expire(), e.g. from a periodic task; get() never returns an expired value.
+//
+// `Clock` is any monotonic clock with a static now(), e.g. a fake one for tests.
+template <typename K,
+          typename V,
+          typename cmp = std::less<K>,
+          typename Clock = std::chrono::steady_clock>
+class BTreeCache {
+   public:
+    using clock = Clock;
+    using time_point = typename Clock::time_point;
+    using duration = typename Clock::duration;
+
+   private:
+    struct entry {
+        V value;
+        // The key in the node that holds this entry.
+        const K *key{nullptr};
+        // Neighbours in the recency list, towards the most and the least recently used.
+        entry *newer{nullptr}, *older{nullptr};
+        // Neighbours in the expiry list, towards the latest and the earliest to expire.
+        entry *later{nullptr}, *earlier{nullptr};
+        time_point expiry;
+
+        explicit entry(const V &value) : value{value} {}
+
+        friend std::size_t heap_usage(const entry &e) noexcept {
+            using btree_memory::heap_usage;
+            return heap_usage(e.value);
+        }
+    };
+
+    BTree<K, entry, cmp> _entries;
+    entry *_newest{nullptr}, *_oldest{nullptr};
+    entry *_latest{nullptr}, *_earliest{nullptr};
+    std::size_t _capacity;
+    duration _ttl;
+    std::size_t _evictions{0}, _expirations{0};
+
+    // Expired entries dropped by every put() and get(): more than one, so that expiry keeps up
+    // with insertions.
+    static constexpr std::size_t _expiry_step = 2;
+
+    bool _expiring() const noexcept { return _ttl > duration::zero(); }
+
+    void _unlink_recency(entry *e) noexcept {
+        (e->newer ? e->newer->older : _newest) = e->older;
+        (e->older ? e->older->newer : _oldest) = e->newer;
+        e->newer = e->older = nullptr;
+    }
+
+    void _push_newest(entry *e) noexcept {
+        e->older = _newest;
+        (_newest ? _newest->newer : _oldest) = e;
+        _newest = e;
+    }
+
+    void _unlink_expiry(entry *e) noexcept {
+        (e->later ? e->later->earlier : _latest) = e->earlier;
+        (e->earlier ? e->earlier->later : _earliest) = e->later;
+        e->later = e->earlier = nullptr;
+    }
+
+    void _push_latest(entry *e) noexcept {
+        e->earlier = _latest;
+        (_latest ? _latest->later : _earliest) = e;
+        _latest = e;
+    }
+
+    void _bump(entry *e) noexcept {
+        if (e != _newest) {
+            _unlink_recency(e);
+            _push_newest(e);
+        }
+    }
+
+    void _remove(entry *e) {
+        _unlink_recency(e);
+        if (_expiring())
+            _unlink_expiry(e);
+        _entries.erase(*e->key);
+    }
+
+    // Drop up to `limit` entries expired by now, returning how many.
+    std::size_t _expire(std::size_t limit) {
+        if (not _earliest)
+            return 0;
+
+        const time_point now = Clock::now();
+        std::size_t expired = 0;
+        for (; expired < limit and _earliest and _earliest->expiry <= now; expired++)
+            _remove(_earliest);
+        _expirations += expired;
+        return expired;
+    }
+
+    // Insert or overwrite; `expiry` is ignored without a time to live.
+    void _put(const K &key, const V &value, time_point expiry) {
+        _expire(_expiry_step);
+
+        auto inserted = _entries.try_insert(key, entry{value});
+        entry *e = &inserted.first.val();
+        if (inserted.second) {
+            e->key = &inserted.first.key();
+            _push_newest(e);
+        } else {
+            e->value = value;
+            _bump(e);
+            if (_expiring())
+                _unlink_expiry(e);
+        }
+        if (_expiring()) {
+            e->expiry = expiry;
+            _push_latest(e);
+        }
+
+        if (_entries.size() > _capacity) {
+            _remove(_oldest);
+            _evictions++;
+        }
+    }
+
+   public:
+    using key_type = K;
+    using value_type = V;
+
+    // A cache of at most `capacity` entries, which expire `ttl` after their last put() unless
+    // it is zero.
+    explicit BTreeCache(std::size_t capacity, duration ttl = duration::zero())
+        : _capacity{capacity}, _ttl{ttl} {
+        if (capacity == 0)
+            throw std::invalid_argument{"BTreeCache: the capacity must be positive"};
+        _entries.auto_balance(2);
+    }
+
+    /* copy ctor: the entries are put again in expiry order, then bumped in recency order */
+    BTreeCache(const BTreeCache &other) : BTreeCache{other._capacity, other._ttl} {
+        if (_expiring()) {
+            for (const entry *e = other._earliest; e; e = e->later)
+                _put(*e->key, e->value, e->expiry);
+            for (const entry *e = other._oldest; e; e = e->newer)
+                get(*e->key);
+        } else {
+            for (const entry *e = other._oldest; e; e = e->newer)
+                _put(*e->key, e->value, e->expiry);
+        }
+        _evictions = other._evictions;
+        _expirations = other._expirations;
+    }
+
+    /* move ctor */
+    BTreeCache(BTreeCache &&other) noexcept
+        : _entries{std::move(other._entries)},
+          _newest{other._newest},
+          _oldest{other._oldest},
+          _latest{other._latest},
+          _earliest{other._earliest},
+          _capacity{other._capacity},
+          _ttl{other._ttl},
+          _evictions{other._evictions},
+          _expirations{other._expirations} {
+        other._newest = other._oldest = other._latest = other._earliest = nullptr;
+    }
+
+    /* copy assignment operator */
+    BTreeCache &operator=(const BTreeCache &other) {
+        BTreeCache tmp(other);
+        *this = std::move(tmp);
+        return *this;
+    }
+
+    /* move assignment operator */
+    BTreeCache &operator=(BTreeCache &&other) noexcept {
+        if (this != &other) {
+            _entries = std::move(other._entries);
+            _newest = other._newest;
+            _oldest = other._oldest;
+            _latest = other._latest;
+            _earliest = other._earliest;
+            other._newest = other._oldest = other._latest = other._earliest = nullptr;
+            _capacity = other._capacity;
+            _ttl = other._ttl;
+            _evictions = other._evictions;
+            _expirations = other._expirations;
+        }
+        return *this;
+    }
+
+    std::size_t size() const noexcept { return _entries.size(); }
+    std::size_t capacity() const noexcept { return _capacity; }
+    duration ttl() const noexcept { return _ttl; }
+
+    // Entries dropped to make room, and because they expired.
+    std::size_t evictions() const noexcept { return _evictions; }
+    std::size_t expirations() const noexcept { return _expirations; }
+
+    // Insert or overwrite, making the entry the most recently used and renewing its time to
+    // live. Evicts the least recently used entry if full.
+    void put(const K &key, const V &value) {
+        _put(key, value, _expiring() ? Clock::now() + _ttl : time_point{});
+    }
+
+    // The value of `key`, made the most recently used, or nullptr if it is missing or expired.
+    // The pointer is valid until the entry is removed.
+    V *get(const K &key) {
+        _expire(_expiry_step);
+
+        auto it = _entries.find(key);
+        if (it == _entries.end())
+            return nullptr;
+
+        entry *e = &it.val();
+        if (_expiring() and e->expiry <= Clock::now()) {
+            _remove(e);
+            _expirations++;
+            return nullptr;
+        }
+        _bump(e);
+        return &e->value;
+    }
+
+    // Whether `key` is present and not expired, without changing its recency.
+    bool contains(const K &key) const noexcept {
+        auto it = _entries.find(key);
+        return it != _entries.end() and (not _expiring() or it.val().expiry > Clock::now());
+    }
+
+    // Returns whether `key` was present.
+    bool erase(const K &key) {
+        auto it = _entries.find(key);
+        if (it == _entries.end())
+            return false;
+        _remove(&it.val());
+        return true;
+    }
+
+    // Drop every expired entry, returning how many there were.
+    std::size_t expire() { return _expire(std::numeric_limits<std::size_t>::max()); }
+
+    void clear() noexcept {
+        _entries.clear();
+        _newest = _oldest = _latest = _earliest = nullptr;
+    }
+
+    // Keys from the most to the least recently used.
+    template <typename KeyOut>
+    void export_by_recency(KeyOut keys) const {
+        for (const entry *e = _newest; e; e = e->older)
+            *keys++ = *e->key;
+    }
+
+    // The links are in the nodes, so this is the memory of the tree.
+    btree_memory::usage memory_usage() const noexcept {
+        btree_memory::usage usage = _entries.memory_usage();
+        usage.object = sizeof(*this);
+        return usage;
+    }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __BTREE_MEMORY_H__
+#define __BTREE_MEMORY_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Memory footprint of a BTree, as returned by `BTree::memory_usage()`.
+//
+// The heap owned by keys and values is measured through the `heap_usage(const T &)`
+// customization point, found by argument-dependent lookup: a type that owns heap memory declares
+// a `heap_usage` overload in its own namespace, returning the bytes it requested from the
+// allocator. Overloads for std::string and std::vector are provided here; every other type is
+// assumed to live entirely inside the node.
+namespace btree_memory {
+
+    struct usage {
+        std::size_t object{0};  // the BTree object itself
+        std::size_t nodes{0};   // sizeof(Node) for every node
+        std::size_t slack{0};   // allocator overhead and rounding of the node allocations
+        std::size_t heap{0};    // heap owned by the keys and the values
+
+        std::size_t total() const noexcept { return object + nodes + slack + heap; }
+    };
+
+    // Bytes taken from the heap by a request of `size` bytes, for a dlmalloc-style allocator such
+    // as glibc's: a size word in front of the block, rounding to twice the word size, and a
+    // minimum chunk of four words. Other allocators differ, but rarely by more than a word.
+    inline std::size_t allocated_size(std::size_t size) noexcept {
+        const std::size_t word = sizeof(std::size_t), align = 2 * word;
+        const std::size_t chunk = (size + word + align - 1) / align * align;
+        return chunk < 4 * word ? 4 * word : chunk;
+    }
+
+    template <typename T>
+    std::size_t heap_usage(const T &) noexcept {
+        return 0;
+    }
+
+    // Short strings are stored inside the object itself.
+    template <typename C, typename T, typename A>
+    std::size_t heap_usage(const std::basic_string<C, T, A> &s) noexcept {
+        const char *object = reinterpret_cast<const char *>(&s);
+        const char *data = reinterpret_cast<const char *>(s.data());
+        if (data >= object and data < object + sizeof(s))
+            return 0;
+        return (s.capacity() + 1) * sizeof(C);
+    }
+
+    template <typename T, typename A>
+    std::size_t heap_usage(const std::vector<T, A> &v) noexcept {
+        std::size_t bytes = v.capacity() * sizeof(T);
+        for (const T &x : v)
+            bytes += heap_usage(x);
+        return bytes;
+    }
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef __BTREE_MULTIMAP_H__
+#define __BTREE_MULTIMAP_H__
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "btree.h"
+#include "small_vector.h"
+
+// A BTree that keeps every value inserted with the same key, e.g. samples with colliding
+// timestamps. Each distinct key is a single node, holding its values contiguously in insertion
+// order in a small_vector: up to `N` values per key cost no allocation besides the node, against
+// one more allocation per key for a BTree<K, std::vector<V>>.
+//
+// Lookups cost O(log n) in the number of distinct keys; count() is O(log n) and iterating over
+// equal_range() O(log n + k) for k values.
+template <typename K,
+          typename V,
+          std::size_t N = 2,
+          typename cmp = std::less<K>,
+          typename stats_policy = btree_stats::none>
+class BTreeMultimap {
+   public:
+    using values_type = small_vector<V, N>;
+    using tree_type = BTree<K, values_type, cmp, stats_policy>;
+
+   private:
+    tree_type _tree;
+    std::size_t _size{0};
+
+   public:
+    using key_type = K;
+    using value_type = V;
+
+    // Forward iterator over the (key, value) pairs, in key order and then in insertion order.
+    //
+    // The end of an equal_range() is kept as (node, number of values), past the last value of
+    // the node, instead of moving on to the next node: finding the successor costs O(log n), and
+    // iterating over the range does not need it. The successor is only looked up if such an
+    // iterator is dereferenced, incremented or compared with one on another node.
+    class const_iterator {
+        mutable typename tree_type::iterator _node;
+        mutable std::size_t _index;
+        bool _stop_in_node;
+
+        void _normalize() const noexcept {
+            if (_node != typename tree_type::iterator{nullptr, nullptr} and
+                _index == _node.val().size()) {
+                ++_node;
+                _index = 0;
+            }
+        }
+
+       public:
+        const_iterator(typename tree_type::iterator node,
+                       std::size_t index,
+                       bool stop_in_node = false) noexcept
+            : _node{node}, _index{index}, _stop_in_node{stop_in_node} {}
+
+        const K &key() const noexcept {
+            _normalize();
+            return _node.key();
+        }
+        const V &val() const noexcept {
+            _normalize();
+            return _node.val()[_index];
+        }
+        const V &operator*() const noexcept { return val(); }
+
+        const_iterator &operator++() noexcept {
+            _normalize();
+            if (++_index == _node.val().size() and not _stop_in_node) {
+                ++_node;
+                _index = 0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int) noexcept {
+            const_iterator it{*this};
+            ++(*this);
+            return it;
+        }
+
+        bool operator==(const const_iterator &other) const noexcept {
+            if (_node == other._node)
+                return _index == other._index;
+            _normalize();
+            other._normalize();
+            return _node == other._node and _index == other._index;
+        }
+        bool operator!=(const const_iterator &other) const noexcept { return not(*this == other); }
+    };
+
+    BTreeMultimap(cmp op = cmp{}) : _tree{op} {}
+
+    // Number of values, and of distinct keys.
+    std::size_t size() const noexcept { return _size; }
+    std::size_t key_count() const noexcept { return _tree.size(); }
+
+    void insert(const K &key, const V &value) {
+        _tree[key].push_back(value);
+        _size++;
+    }
+
+    std::size_t count(const K &key) const noexcept {
+        auto it = _tree.find(key);
+        return it == _tree.end() ? 0 : it.val().size();
+    }
+
+    // The values of `key`, contiguous and in insertion order, or nullptr if it is missing.
+    const values_type *values(const K &key) const noexcept {
+        auto it = _tree.find(key);
+        return it == _tree.end() ? nullptr : &it.val();
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const K &key) const noexcept {
+        auto node = _tree.find(key);
+        if (node == _tree.end())
+            return {end(), end()};
+        return {const_iterator{node, 0, true}, const_iterator{node, node.val().size(), true}};
+    }
+
+    // Remove every value of `key`, returning how many there were; unlike BTree::erase, a missing
+    // key is not an error, as for std::multimap.
+    std::size_t erase(const K &key) {
+        auto it = _tree.find(key);
+        if (it == _tree.end())
+            return 0;
+
+        std::size_t erased = it.val().size();
+        _tree.erase(key);
+        _size -= erased;
+        return erased;
+    }
+
+    void clear() noexcept {
+        _tree.clear();
+        _size = 0;
+    }
+
+    const_iterator begin() const noexcept { return const_iterator{_tree.begin(), 0}; }
+    const_iterator end() const noexcept { return const_iterator{_tree.end(), 0}; }
+
+    void balance() noexcept { _tree.balance(); }
+    void auto_balance(double factor) noexcept { _tree.auto_balance(factor); }
+    unsigned int height() const noexcept { return _tree.height(); }
+    btree_memory::usage memory_usage() const noexcept { return _tree.memory_usage(); }
+
+    // The underlying tree, e.g. for its statistics.
+    const tree_type &tree() const noexcept { return _tree; }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef __BTREE_STATS_H__
+#define __BTREE_STATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+
+// Statistics policies for BTree, selected with its fourth template argument.
+// `btree_stats::none` (the default) has only empty inline hooks, so the compiler removes every
+// call from the hot paths; `btree_stats::counting` records what happens inside the tree and can be
+// read back with `BTree::stats()`.
+namespace btree_stats {
+
+    // Lookups that visit more nodes than this are all counted in the last bucket of the histogram.
+    constexpr unsigned int histogram_buckets = 64;
+
+    struct snapshot {
+        unsigned long long comparisons{0};
+        unsigned long long lookups{0};
+        unsigned long long nodes_visited{0};
+        unsigned long long max_visited{0};
+        unsigned long long allocations{0};
+        unsigned long long balances{0};
+        unsigned long long balance_ns{0};
+        unsigned int height{0};
+
+        // visited[i] is the number of lookups that visited exactly i nodes.
+        unsigned long long visited[histogram_buckets]{};
+
+        double mean_visited() const noexcept {
+            return lookups ? (double)nodes_visited / lookups : 0.0;
+        }
+    };
+
+    class none {
+       public:
+        static constexpr bool enabled = false;
+
+        void comparison(unsigned int = 1) const noexcept {}
+        void lookup(unsigned int) const noexcept {}
+        void allocation() const noexcept {}
+        void fill(snapshot &) const noexcept {}
+        void reset() noexcept {}
+
+        class timer {
+           public:
+            explicit timer(const none &) noexcept {}
+        };
+    };
+
+    // The counters are relaxed atomics, so that concurrent readers of a tree (see rw_lock.h) can
+    // record their lookups; a snapshot taken while they run is not an exact point in time.
+    class counting {
+        using counter = std::atomic<unsigned long long>;
+
+        mutable counter _comparisons{0};
+        mutable counter _lookups{0};
+        mutable counter _nodes_visited{0};
+        mutable counter _max_visited{0};
+        mutable counter _allocations{0};
+        mutable counter _balances{0};
+        mutable counter _balance_ns{0};
+        mutable counter _visited[histogram_buckets]{};
+
+        static void add(counter &c, unsigned long long n) noexcept {
+            c.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        static unsigned long long load(const counter &c) noexcept {
+            return c.load(std::memory_order_relaxed);
+        }
+
+       public:
+        static constexpr bool enabled = true;
+
+        void comparison(unsigned int n = 1) const noexcept { add(_comparisons, n); }
+
+        void lookup(unsigned int visited) const noexcept {
+            add(_lookups, 1);
+            add(_nodes_visited, visited);
+            add(_visited[visited < histogram_buckets ? visited : histogram_buckets - 1], 1);
+
+            unsigned long long max = load(_max_visited);
+            while (visited > max and not _max_visited.compare_exchange_weak(
+                                         max, visited, std::memory_order_relaxed)) {
+            }
+        }
+
+        void allocation() const noexcept { add(_allocations, 1); }
+
+        void fill(snapshot &out) const noexcept {
+            out.comparisons = load(_comparisons);
+            out.lookups = load(_lookups);
+            out.nodes_visited = load(_nodes_visited);
+            out.max_visited = load(_max_visited);
+            out.allocations = load(_allocations);
+            out.balances = load(_balances);
+            out.balance_ns = load(_balance_ns);
+            for (unsigned int i = 0; i < histogram_buckets; i++)
+                out.visited[i] = load(_visited[i]);
+        }
+
+        void reset() noexcept {
+            for (counter *c : {&_comparisons, &_lookups, &_nodes_visited, &_max_visited,
+                               &_allocations, &_balances, &_balance_ns})
+                c->store(0, std::memory_order_relaxed);
+            for (counter &c : _visited)
+                c.store(0, std::memory_order_relaxed);
+        }
+
+        // Counts one balance() call and its duration, measured from construction to destruction.
+        class timer {
+            const counting &_owner;
+            const std::chrono::steady_clock::time_point _start;
+
+           public:
+            explicit timer(const counting &owner) noexcept
+                : _owner{owner}, _start{std::chrono::steady_clock::now()} {}
+
+            ~timer() {
+                auto elapsed = std::chrono::steady_clock::now() - _start;
+                add(_owner._balances, 1);
+                add(_owner._balance_ns,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            }
+        };
+    };
+}
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef __BTREE_WAL_H__
+#define __BTREE_WAL_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>  // std::rename
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+// Durable BTree for trivially copyable keys and values, kept in a directory as a snapshot, in
+// the format of BTree::serialize(), and a write-ahead log of the writes made since.
+//
+// Every write is appended to the log before it is applied to the tree. The log is written with
+// group commit: the records are buffered and written with a single fsync once `group_size` of
+// them are pending, or the oldest of them has waited `max_delay`, or by sync(). Both limits are
+// checked on the writes only: the last writes before a pause stay pending until the next write,
+// sync() or the destructor, so callers that need them durable must call sync(). A crash loses
+// at most the writes not synced yet, and never leaves a hole: recovery replays the snapshot and
+// then the log up to its first torn or corrupted record, a prefix of the history.
+//
+// A snapshot is written aside and renamed over the previous one before the log is emptied; the
+// writes are blind (set or erase a key), so if a crash comes in between, replaying the old log
+// over the new snapshot is harmless.
+//
+// POSIX only. I/O errors throw std::system_error, after which the tree may be ahead of the log:
+// reopen the directory to go back to what is durable.
+namespace btree_wal {
+
+    struct options {
+        // Writes per fsync: 1 makes every write durable before it returns.
+        std::size_t group_size{64};
+        // Also sync a smaller group on the first write made this long after its oldest record;
+        // 0 for no limit.
+        std::chrono::microseconds max_delay{0};
+        // Take a snapshot once the log holds this many records; 0 leaves it to snapshot().
+        std::size_t snapshot_every{0};
+    };
+
+    [[noreturn]] inline void fail(const std::string &what) {
+        throw std::system_error{errno, std::generic_category(), what};
+    }
+
+    // A file descriptor, closed on destruction.
+    class file {
+        int _fd{-1};
+        std::string _path;
+
+       public:
+        file() = default;
+        file(const std::string &path, int flags)
+            : _fd{::open(path.c_str(), flags, 0644)}, _path{path} {
+            if (_fd < 0)
+                fail("cannot open " + path);
+        }
+        ~file() {
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+
+        file(file &&other) noexcept : _fd{other._fd}, _path{std::move(other._path)} {
+            other._fd = -1;
+        }
+        file &operator=(file &&other) noexcept {
+            std::swap(_fd, other._fd);
+            std::swap(_path, other._path);
+            return *this;
+        }
+
+        void write(const char *data, std::size_t size) {
+            while (size > 0) {
+                ssize_t written = ::write(_fd, data, size);
+                if (written < 0 and errno == EINTR)
+                    continue;
+                if (written < 0)
+                    fail("cannot write " + _path);
+                data += written;
+                size -= written;
+            }
+        }
+        void sync() {
+            if (::fsync(_fd) != 0)
+                fail("cannot sync " + _path);
+        }
+        void truncate(std::size_t size) {
+            if (::ftruncate(_fd, size) != 0)
+                fail("cannot truncate " + _path);
+        }
+    };
+
+    // Make the creation and the renaming of the files in `directory` durable.
+    inline void sync_directory(const std::string &directory) {
+        file{directory, O_RDONLY | O_DIRECTORY}.sync();
+    }
+
+    // The whole content of `path`, or false if it cannot be read.
+    inline bool read_file(const std::string &path, std::vector<char> &data) {
+        std::ifstream in{path, std::ios::binary};
+        if (not in)
+            return false;
+        data.assign(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{});
+        return true;
+    }
+
+    // FNV-1a: cheap, and enough to tell a torn record from a whole one.
+    inline std::uint32_t checksum(const char *data, std::size_t size) noexcept {
+        std::uint32_t hash = 2166136261u;
+        for (std::size_t i = 0; i < size; i++)
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        return hash;
+    }
+}
+
+template <typename K, typename V, typename cmp = std::less<K>>
+class DurableBTree {
+    static_assert(std::is_trivially_copyable<K>::value and std::is_trivially_copyable<V>::value,
+                  "DurableBTree logs the bytes of the keys and the values");
+
+    enum class op : char { insert = 'i', erase = 'e' };
+
+    // The records have a fixed size: the operation, the key, the value (zeros for an erase) and
+    // the checksum of the rest.
+    static constexpr std::size_t _record_size = 1 + sizeof(K) + sizeof(V) + sizeof(std::uint32_t);
+
+    struct _log_header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t key_size;
+        std::uint32_t value_size;
+    };
+
+    BTree<K, V, cmp> _tree;
+    const std::string _directory;
+    const btree_wal::options _options;
+    btree_wal::file _log;
+
+    // The records not written yet, when the oldest of them was appended, and counters.
+    std::vector<char> _pending;
+    std::chrono::steady_clock::time_point _pending_since;
+    std::size_t _pending_records{0}, _log_records{0}, _syncs{0};
+
+    bool _overdue() const noexcept {
+        return _options.max_delay.count() > 0 and
+               std::chrono::steady_clock::now() - _pending_since >= _options.max_delay;
+    }
+
+    std::string _path(const char *name) const { return _directory + "/" + name; }
+
+    static _log_header _expected_header() noexcept {
+        return {{'B', 'S', 'T', 'W'}, 1, sizeof(K), sizeof(V)};
+    }
+
+    void _append(op o, const K &key, const V *value) {
+        std::size_t offset = _pending.size();
+        _pending.resize(offset + _record_size);
+        char *record = &_pending[offset];
+
+        record[0] = static_cast<char>(o);
+        std::memcpy(record + 1, &key, sizeof(K));
+        if (value)
+            std::memcpy(record + 1 + sizeof(K), value, sizeof(V));
+        std::uint32_t sum = btree_wal::checksum(record, _record_size - sizeof(sum));
+        std::memcpy(record + _record_size - sizeof(sum), &sum, sizeof(sum));
+
+        _log_records++;
+        if (_pending_records++ == 0 and _options.max_delay.count() > 0)
+            _pending_since = std::chrono::steady_clock::now();
+        if (_pending_records >= _options.group_size or _overdue())
+            sync();
+    }
+
+    void _maybe_snapshot() {
+        if (_options.snapshot_every > 0 and _log_records >= _options.snapshot_every)
+            snapshot();
+    }
+
+    // Apply a record read from the log, returning false if it is torn or corrupted.
+    bool _replay(const char *record) {
+        std::uint32_t sum;
+        std::memcpy(&sum, record + _record_size - sizeof(sum), sizeof(sum));
+        if (sum != btree_wal::checksum(record, _record_size - sizeof(sum)))
+            return false;
+
+        K key;
+        V value;
+        std::memcpy(&key, record + 1, sizeof(K));
+        std::memcpy(&value, record + 1 + sizeof(K), sizeof(V));
+        switch (static_cast<op>(record[0])) {
+            case op::insert:
+                _tree.insert(key, value);
+                return true;
+            case op::erase:
+                if (_tree.find(key) != _tree.end())
+                    _tree.erase(key);
+                return true;
+        }
+        return false;
+    }
+
+    void _recover() {
+        std::vector<char> data;
+        if (btree_wal::read_file(_path("snapshot"), data))
+            _tree.deserialize(data.data(), data.size());
+        ::unlink(_path("snapshot.tmp").c_str());  // from a crash while writing one
+
+        _log = btree_wal::file{_path("log"), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC};
+        btree_wal::read_file(_path("log"), data);
+
+        const _log_header expected = _expected_header();
+        if (data.size() < sizeof(_log_header)) {
+            // A new log, or one whose header did not make it to the disk.
+            _log.truncate(0);
+            _log.write(reinterpret_cast<const char *>(&expected), sizeof(expected));
+            _log.sync();
+            btree_wal::sync_directory(_directory);
+            return;
+        }
+        if (std::memcmp(data.data(), &expected, sizeof(expected)) != 0)
+            throw std::invalid_argument{"DurableBTree: " + _path("log") +
+                                        " is not a log of this key and value types"};
+
+        std::size_t offset = sizeof(_log_header);
+        for (; offset + _record_size <= data.size() and _replay(&data[offset]);
+             offset += _record_size)
+            _log_records++;
+
+        // Drop a torn tail, so that the next records follow the last whole one.
+        if (offset != data.size()) {
+            _log.truncate(offset);
+            _log.sync();
+        }
+    }
+
+   public:
+    using key_type = K;
+    using value_type = V;
+
+    // Open the tree kept in `directory`, which must exist, recovering its content.
+    explicit DurableBTree(const std::string &directory, btree_wal::options options = {})
+        : _directory{directory}, _options{options} {
+        if (options.group_size == 0)
+            throw std::invalid_argument{"DurableBTree: the group size must be positive"};
+        _tree.auto_balance(2);
+        _recover();
+    }
+
+    DurableBTree(const DurableBTree &) = delete;
+    DurableBTree &operator=(const DurableBTree &) = delete;
+
+    // Syncs the pending writes, ignoring errors: call sync() first to see them.
+    ~DurableBTree() {
+        try {
+            sync();
+        } catch (const std::system_error &) {
+        }
+    }
+
+    // Read access; the writes must go through this class to be logged.
+    const BTree<K, V, cmp> &tree() const noexcept { return _tree; }
+    const unsigned int &size() const noexcept { return _tree.size(); }
+
+    bool insert(const K &key, const V &value) {
+        _append(op::insert, key, &value);
+        _tree.insert(key, value);
+        _maybe_snapshot();
+        return true;
+    }
+
+    // Throws KeyNotFound, logging nothing, if `key` is missing.
+    std::pair<K, V> erase(const K &key) {
+        if (_tree.find(key) == _tree.end())
+            throw KeyNotFound{};
+        _append(op::erase, key, nullptr);
+        std::pair<K, V> erased = _tree.erase(key);
+        _maybe_snapshot();
+        return erased;
+    }
+
+    // The value of a key, for reading and for assignment, which is logged like an insert. As for
+    // BTree, reading a missing key inserts a default value.
+    class reference {
+        DurableBTree &_owner;
+        const K _key;
+
+       public:
+        reference(DurableBTree &owner, const K &key) : _owner{owner}, _key{key} {}
+
+        reference &operator=(const V &value) {
+            _owner.insert(_key, value);
+            return *this;
+        }
+        operator V() const {
+            auto it = _owner._tree.find(_key);
+            if (it != _owner._tree.end())
+                return it.val();
+            _owner.insert(_key, V{});
+            return V{};
+        }
+    };
+    reference operator[](const K &key) { return reference{*this, key}; }
+    const V &operator[](const K &key) const { return _tree[key]; }
+
+    // Write the pending records and wait for them to reach the disk.
+    void sync() {
+        if (_pending.empty())
+            return;
+        _log.write(_pending.data(), _pending.size());
+        _log.sync();
+        _pending.clear();
+        _pending_records = 0;
+        _syncs++;
+    }
+
+    // Write the whole tree as the new snapshot and empty the log.
+    void snapshot() {
+        std::vector<char> buffer(_tree.serialized_size());
+        _tree.serialize(buffer.data());
+        {
+            btree_wal::file tmp{_path("snapshot.tmp"), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC};
+            tmp.write(buffer.data(), buffer.size());
+            tmp.sync();
+        }
+        if (std::rename(_path("snapshot.tmp").c_str(), _path("snapshot").c_str()) != 0)
+            btree_wal::fail("cannot rename " + _path("snapshot.tmp"));
+        btree_wal::sync_directory(_directory);
+
+        // The snapshot holds the pending writes too.
+        _log.truncate(sizeof(_log_header));
+        _log.sync();
+        _pending.clear();
+        _pending_records = _log_records = 0;
+    }
+
+    // Records in the log, written or pending, and the fsyncs of the log so far.
+    std::size_t log_records() const noexcept { return _log_records; }
+    std::size_t syncs() const noexcept { return _syncs; }
+};
+
+#endif
@@ -0,0 +1,534 @@
+#ifndef __RADIX_H__
+#define __RADIX_H__
+
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "btree.h"  // KeyNotFound
+
+// Ordered map specialized for integer keys, with the same interface as BTree.
+// Keys are split into bytes, from the most significant one, and each byte selects a child in a
+// 256-way radix tree: a lookup visits exactly sizeof(K) inner nodes plus the leaf, without calling
+// any comparator. Inner nodes are adaptive: they keep up to 16 children in a small sorted array
+// and switch to a direct 256-slot table when they grow, so that sparse key sets stay compact.
+template <typename K, typename V>
+class RadixTree {
+    static_assert(std::is_integral<K>::value, "RadixTree keys must be integers");
+
+    using bits_type = typename std::make_unsigned<K>::type;
+    static constexpr int depth = sizeof(K);
+    static constexpr int sparse_capacity = 16;
+
+    class Leaf;
+    class Inner;
+    class Sparse;
+    class Dense;
+
+    Inner *root{nullptr};
+    unsigned int _size{0};
+
+    // Flip the sign bit, so that signed keys are ordered like their unsigned representation.
+    static bits_type _bits(const K &key) noexcept {
+        bits_type bits = static_cast<bits_type>(key);
+        if (std::is_signed<K>::value)
+            bits ^= bits_type(1) << (8 * sizeof(K) - 1);
+        return bits;
+    }
+
+    static unsigned char _byte(bits_type bits, int level) noexcept {
+        return (bits >> (8 * (depth - 1 - level))) & 0xff;
+    }
+
+    void _destroy(Inner *node, int level) noexcept;
+    Leaf *_insert(const K &key, const V &value, bool overwrite);
+
+    // Store `node` in `slot` of `parent`, or at the root if `parent` is null: the slots are
+    // `void *`, so they are never accessed through `Inner *` lvalues.
+    void _relink(Inner *parent, int slot, Inner *node) noexcept {
+        if (parent)
+            parent->slots[slot] = node;
+        else
+            root = node;
+    }
+
+   public:
+    using key_type = K;
+    using value_type = V;
+
+    RadixTree() noexcept = default;
+    ~RadixTree() noexcept { clear(); }
+
+    const unsigned int &size() const noexcept { return _size; }
+
+    bool insert(const K &key, const V &value) {
+        _insert(key, value, true);
+        return true;
+    }
+
+    void print() const noexcept;
+    bool clear() noexcept;
+
+    class iterator;
+    class const_iterator;
+    iterator begin() noexcept { return iterator{this}; }
+    iterator end() noexcept { return iterator{}; }
+    const_iterator begin() const noexcept { return cbegin(); }
+    const_iterator end() const noexcept { return cend(); }
+
+    const_iterator cbegin() const noexcept { return const_iterator{this}; }
+    const_iterator cend() const noexcept { return const_iterator{}; }
+
+    iterator find(const K &key) const noexcept;
+
+    // First element whose key is not less than `key` (end() if there is none).
+    iterator lower_bound(const K &key) const noexcept { return iterator{this, key}; }
+
+    std::pair<K, V> erase(const K &key);
+
+    V &operator[](const K &key) { return _insert(key, V{}, false)->val(); }
+
+    /* copy ctor */
+    RadixTree(const RadixTree &other) : RadixTree() {
+        for (auto it = other.cbegin(); it != other.cend(); ++it)
+            insert(it.key(), it.val());
+    }
+
+    /* move ctor */
+    RadixTree(RadixTree &&other) noexcept : root{other.root}, _size{other._size} {
+        other.root = nullptr;
+        other._size = 0;
+    }
+
+    /* copy assignment operator */
+    RadixTree &operator=(const RadixTree &other) {
+        RadixTree tmp(other);
+        *this = std::move(tmp);
+        return *this;
+    }
+
+    /* move assignment operator */
+    RadixTree &operator=(RadixTree &&other) noexcept {
+        if (this == &other)
+            return *this;
+
+        clear();
+        root = other.root;
+        _size = other._size;
+        other.root = nullptr;
+        other._size = 0;
+
+        return *this;
+    }
+};
+
+template <typename K, typename V>
+class RadixTree<K, V>::Leaf {
+   public:
+    const K _key;
+    V _val;
+
+    Leaf(const K &key, const V &val) : _key{key}, _val{val} {}
+
+    const std::pair<K, V> pair() const noexcept { return std::make_pair(_key, _val); }
+    const K &key() const noexcept { return _key; }
+
+    V &val() noexcept { return _val; }
+    const V &val() const noexcept { return _val; }
+};
+
+// Children are Inner nodes, except at the last level where they are Leaf nodes.
+// Sparse nodes keep `count` children sorted by the byte stored in `index`; dense nodes address
+// `slots` directly by byte. The `slot` of a child is its position in `slots` in both cases.
+template <typename K, typename V>
+class RadixTree<K, V>::Inner {
+   protected:
+    Inner(bool is_dense, void **children) noexcept : dense{is_dense}, slots{children} {}
+
+   public:
+    unsigned short count{0};
+    const bool dense;
+    unsigned char index[sparse_capacity];
+    void **const slots;  // points to the children array of Sparse or Dense
+
+    Inner(const Inner &) = delete;
+    Inner &operator=(const Inner &) = delete;
+
+    static Inner *make(bool dense) {
+        if (dense)
+            return new Dense;
+        return new Sparse;
+    }
+    static void release(Inner *node) noexcept {
+        if (node->dense)
+            delete static_cast<Dense *>(node);
+        else
+            delete static_cast<Sparse *>(node);
+    }
+
+    unsigned char byte(int slot) const noexcept { return dense ? slot : index[slot]; }
+
+    // Slot of the child for `byte`, or -1.
+    int find(unsigned char byte) const noexcept {
+        if (dense)
+            return slots[byte] ? byte : -1;
+
+        for (int i = 0; i < count; i++) {
+            if (index[i] == byte)
+                return i;
+        }
+        return -1;
+    }
+
+    // First used slot whose byte is not less than `byte`, or -1.
+    int lower(unsigned char byte) const noexcept {
+        if (dense) {
+            for (int i = byte; i < 256; i++) {
+                if (slots[i])
+                    return i;
+            }
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (index[i] >= byte)
+                return i;
+        }
+        return -1;
+    }
+
+    // First used slot after `slot` (-1 to start from the beginning), or -1.
+    int next(int slot) const noexcept {
+        if (not dense)
+            return slot + 1 < count ? slot + 1 : -1;
+
+        for (int i = slot + 1; i < 256; i++) {
+            if (slots[i])
+                return i;
+        }
+        return -1;
+    }
+
+    bool full() const noexcept { return not dense and count == sparse_capacity; }
+
+    // Add a child for a byte that is not present; the node must not be full.
+    void add(unsigned char byte, void *child) noexcept {
+        count++;
+        if (dense) {
+            slots[byte] = child;
+            return;
+        }
+
+        int i = count - 1;
+        for (; i > 0 and index[i - 1] > byte; i--) {
+            index[i] = index[i - 1];
+            slots[i] = slots[i - 1];
+        }
+        index[i] = byte;
+        slots[i] = child;
+    }
+
+    void remove(int slot) noexcept {
+        count--;
+        if (dense) {
+            slots[slot] = nullptr;
+            return;
+        }
+
+        for (int i = slot; i < count; i++) {
+            index[i] = index[i + 1];
+            slots[i] = slots[i + 1];
+        }
+        slots[count] = nullptr;
+    }
+
+    // Copy of this node with the other layout.
+    Inner *convert() const {
+        Inner *other = make(not dense);
+        for (int slot = next(-1); slot != -1; slot = next(slot))
+            other->add(byte(slot), slots[slot]);
+        return other;
+    }
+};
+
+template <typename K, typename V>
+class RadixTree<K, V>::Sparse : public RadixTree<K, V>::Inner {
+    void *children[sparse_capacity]{};
+
+   public:
+    Sparse() noexcept : Inner{false, children} {}
+};
+
+template <typename K, typename V>
+class RadixTree<K, V>::Dense : public RadixTree<K, V>::Inner {
+    void *children[256]{};
+
+   public:
+    Dense() noexcept : Inner{true, children} {}
+};
+
+template <typename K, typename V>
+class RadixTree<K, V>::iterator : public std::iterator<std::forward_iterator_tag, K> {
+    // Path from the root to the current leaf: the node and the slot taken at every level.
+    Inner *_nodes[depth]{};
+    int _slots[depth]{};
+    Leaf *_current{nullptr};
+
+    // Go down from `level` always taking the first child.
+    void _leftmost(int level) noexcept {
+        for (; level < depth; level++) {
+            _slots[level] = _nodes[level]->next(-1);
+            if (level + 1 < depth)
+                _nodes[level + 1] = static_cast<Inner *>(_nodes[level]->slots[_slots[level]]);
+        }
+        _current = static_cast<Leaf *>(_nodes[depth - 1]->slots[_slots[depth - 1]]);
+    }
+
+    // Move to the first leaf after the subtree selected at `level`.
+    void _advance(int level) noexcept {
+        for (; level >= 0; level--) {
+            int slot = _nodes[level]->next(_slots[level]);
+            if (slot != -1) {
+                _slots[level] = slot;
+                if (level + 1 < depth) {
+                    _nodes[level + 1] = static_cast<Inner *>(_nodes[level]->slots[slot]);
+                    _leftmost(level + 1);
+                } else {
+                    _current = static_cast<Leaf *>(_nodes[level]->slots[slot]);
+                }
+                return;
+            }
+        }
+        _current = nullptr;
+    }
+
+   public:
+    iterator() noexcept = default;
+
+    // Place the iterator at the beginning of the tree.
+    explicit iterator(const RadixTree *tree_ref) noexcept {
+        if (tree_ref->root) {
+            _nodes[0] = tree_ref->root;
+            _leftmost(0);
+        }
+    }
+
+    // Place the iterator at the first key not less than `key`.
+    iterator(const RadixTree *tree_ref, const K &key) noexcept {
+        if (not tree_ref->root)
+            return;
+
+        const bits_type bits = _bits(key);
+        _nodes[0] = tree_ref->root;
+
+        for (int level = 0; level < depth; level++) {
+            const unsigned char byte = _byte(bits, level);
+            const int slot = _nodes[level]->lower(byte);
+
+            if (slot == -1) {
+                // Every key below this node is smaller: continue after its parent's subtree.
+                if (level > 0)
+                    _advance(level - 1);
+                return;
+            }
+
+            _slots[level] = slot;
+            Inner *node = _nodes[level];
+            if (node->byte(slot) != byte) {
+                // All keys below this child are greater: take the smallest one.
+                if (level + 1 < depth) {
+                    _nodes[level + 1] = static_cast<Inner *>(node->slots[slot]);
+                    _leftmost(level + 1);
+                } else {
+                    _current = static_cast<Leaf *>(node->slots[slot]);
+                }
+                return;
+            }
+
+            if (level + 1 < depth)
+                _nodes[level + 1] = static_cast<Inner *>(node->slots[slot]);
+            else
+                _current = static_cast<Leaf *>(node->slots[slot]);
+        }
+    }
+
+    const K &key() const noexcept { return _current->key(); }
+    V &val() noexcept { return _current->val(); }
+    const V &val() const noexcept { return _current->val(); }
+
+    const std::pair<K, V> pair() const noexcept { return _current->pair(); }
+
+    V &operator*() const noexcept { return _current->val(); }
+
+    // ++it
+    iterator &operator++() noexcept {
+        if (_current)
+            _advance(depth - 1);
+        return *this;
+    }
+
+    // it++
+    iterator operator++(int) noexcept {
+        iterator it{*this};
+        ++(*this);
+        return it;
+    }
+
+    bool operator==(const iterator &other) const noexcept { return _current == other._current; }
+    bool operator!=(const iterator &other) const noexcept { return not(*this == other); }
+};
+
+template <typename K, typename V>
+class RadixTree<K, V>::const_iterator : public RadixTree<K, V>::iterator {
+   public:
+    using iterator::iterator;
+
+    const V &operator*() const noexcept { return RadixTree<K, V>::iterator::operator*(); }
+};
+
+template <typename K, typename V>
+void RadixTree<K, V>::_destroy(Inner *node, int level) noexcept {
+    for (int slot = node->next(-1); slot != -1; slot = node->next(slot)) {
+        if (level + 1 < depth)
+            _destroy(static_cast<Inner *>(node->slots[slot]), level + 1);
+        else
+            delete static_cast<Leaf *>(node->slots[slot]);
+    }
+    Inner::release(node);
+}
+
+template <typename K, typename V>
+bool RadixTree<K, V>::clear() noexcept {
+    if (root) {
+        _destroy(root, 0);
+        root = nullptr;
+        _size = 0;
+    }
+    return true;
+}
+
+template <typename K, typename V>
+typename RadixTree<K, V>::iterator RadixTree<K, V>::find(const K &key) const noexcept {
+    // A lower_bound that stops on an equal key places the iterator with its whole path.
+    iterator it = lower_bound(key);
+    if (it != cend() and it.key() == key)
+        return it;
+    return iterator{};
+}
+
+template <typename K, typename V>
+typename RadixTree<K, V>::Leaf *RadixTree<K, V>::_insert(const K &key,
+                                                        const V &value,
+                                                        bool overwrite) {
+    const bits_type bits = _bits(key);
+
+    if (not root)
+        root = Inner::make(false);
+
+    Inner *parent = nullptr, *node = root;
+    int parent_slot = -1;
+    for (int level = 0;; level++) {
+        const unsigned char byte = _byte(bits, level);
+        int slot = node->find(byte);
+
+        if (slot == -1) {
+            void *child;
+            if (level + 1 < depth)
+                child = Inner::make(false);
+            else
+                child = new Leaf(key, value);
+
+            if (node->full()) {
+                Inner *converted = node->convert();
+                _relink(parent, parent_slot, converted);
+                Inner::release(node);
+                node = converted;
+            }
+            node->add(byte, child);
+            slot = node->find(byte);
+
+            if (level + 1 == depth) {
+                _size++;
+                return static_cast<Leaf *>(child);
+            }
+        } else if (level + 1 == depth) {
+            Leaf *leaf = static_cast<Leaf *>(node->slots[slot]);
+            if (overwrite)
+                leaf->val() = value;
+            return leaf;
+        }
+
+        parent = node;
+        parent_slot = slot;
+        node = static_cast<Inner *>(node->slots[slot]);
+    }
+}
+
+template <typename K, typename V>
+std::pair<K, V> RadixTree<K, V>::erase(const K &key) {
+    const bits_type bits = _bits(key);
+    Inner *nodes[depth];
+    int slots[depth];
+
+    if (not root)
+        throw KeyNotFound{};
+
+    nodes[0] = root;
+    for (int level = 0; level < depth; level++) {
+        slots[level] = nodes[level]->find(_byte(bits, level));
+        if (slots[level] == -1)
+            throw KeyNotFound{};
+        if (level + 1 < depth)
+            nodes[level + 1] = static_cast<Inner *>(nodes[level]->slots[slots[level]]);
+    }
+
+    Leaf *leaf = static_cast<Leaf *>(nodes[depth - 1]->slots[slots[depth - 1]]);
+    std::pair<K, V> erased = leaf->pair();
+    delete leaf;
+    _size--;
+
+    // Remove the emptied nodes bottom-up, and shrink dense nodes that became sparse enough.
+    for (int level = depth - 1; level >= 0; level--) {
+        Inner *node = nodes[level];
+        Inner *parent = level > 0 ? nodes[level - 1] : nullptr;
+        const int parent_slot = level > 0 ? slots[level - 1] : -1;
+        node->remove(slots[level]);
+
+        if (node->count == 0) {
+            Inner::release(node);
+            // The parent removes the slot at the next level up.
+            if (not parent)
+                root = nullptr;
+            continue;
+        }
+
+        if (node->dense and node->count <= sparse_capacity / 2) {
+            _relink(parent, parent_slot, node->convert());
+            Inner::release(node);
+        }
+        break;
+    }
+
+    return erased;
+}
+
+template <typename K, typename V>
+void RadixTree<K, V>::print() const noexcept {
+    const_iterator it = begin();
+
+    std::cout << "{";
+
+    if (it != end()) {
+        std::cout << "'" << it.key() << "': '" << it.val() << "'";
+        it++;
+    }
+
+    for (; it != end(); ++it) {
+        std::cout << ", '" << it.key() << "': '" << it.val() << "'";
+    }
+
+    std::cout << "}" << std::endl;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __RW_LOCK_H__
+#define __RW_LOCK_H__
+
+#include <condition_variable>
+#include <mutex>
+
+// Reader-writer lock for sharing a tree among threads: any number of readers (find, lower_bound,
+// size, height, ...) can hold it at the same time, while writers (insert, erase, balance, ...)
+// hold it alone. Waiting writers block new readers, so a steady stream of lookups cannot starve
+// them.
+// It follows the standard SharedMutex interface, so it works with std::unique_lock and, from
+// C++14 on, std::shared_lock; read_guard is the C++11 counterpart of the latter.
+class rw_lock {
+    std::mutex _mutex;
+    std::condition_variable _readers_cv;
+    std::condition_variable _writers_cv;
+    unsigned int _readers{0};
+    unsigned int _waiting_writers{0};
+    bool _writer{false};
+
+   public:
+    rw_lock() = default;
+    rw_lock(const rw_lock &) = delete;
+    rw_lock &operator=(const rw_lock &) = delete;
+
+    void lock() {
+        std::unique_lock<std::mutex> guard{_mutex};
+        _waiting_writers++;
+        _writers_cv.wait(guard, [this] { return not _writer and _readers == 0; });
+        _waiting_writers--;
+        _writer = true;
+    }
+
+    void unlock() {
+        {
+            std::lock_guard<std::mutex> guard{_mutex};
+            _writer = false;
+        }
+        _writers_cv.notify_one();
+        _readers_cv.notify_all();
+    }
+
+    void lock_shared() {
+        std::unique_lock<std::mutex> guard{_mutex};
+        _readers_cv.wait(guard, [this] { return not _writer and _waiting_writers == 0; });
+        _readers++;
+    }
+
+    void unlock_shared() {
+        bool last;
+        {
+            std::lock_guard<std::mutex> guard{_mutex};
+            last = --_readers == 0;
+        }
+        if (last)
+            _writers_cv.notify_one();
+    }
+
+    class read_guard {
+        rw_lock &_lock;
+
+       public:
+        explicit read_guard(rw_lock &lock) : _lock{lock} { _lock.lock_shared(); }
+        ~read_guard() { _lock.unlock_shared(); }
+
+        read_guard(const read_guard &) = delete;
+        read_guard &operator=(const read_guard &) = delete;
+    };
+
+    using write_guard = std::lock_guard<rw_lock>;
+};
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef __SHARDED_BTREE_H__
+#define __SHARDED_BTREE_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+#include "rw_lock.h"
+
+// A map split over N independent BTrees, the shards, each with its own reader-writer lock, so
+// that threads writing to different shards do not wait for each other. Every operation locks a
+// single shard; ordered() locks them all for reading and merges them into one ordered sequence.
+//
+// The keys are partitioned by hash, which spreads any key distribution evenly, or by ranges,
+// which keep the shards ordered but must follow the distribution: their boundaries start empty,
+// with every key in the first shard, and are moved to the quantiles of the keys by rebalance(),
+// called automatically when a shard grows beyond `skew` times the average. A rebalance locks all
+// the shards and rebuilds them, in O(n) time.
+template <typename K,
+          typename V,
+          typename cmp = std::less<K>,
+          std::size_t N = 8,
+          typename hash = std::hash<K>>
+class ShardedBTree {
+    static_assert(N > 0, "ShardedBTree needs at least one shard");
+
+   public:
+    using key_type = K;
+    using value_type = V;
+    using tree_type = BTree<K, V, cmp>;
+
+    enum class partitioning { by_hash, by_range };
+    static constexpr std::size_t shards = N;
+
+   private:
+    // Aligned to a cache line, so that the locks of neighbouring shards do not share one.
+    struct alignas(64) shard {
+        rw_lock lock;
+        tree_type tree;
+        // The size of the tree, readable without the lock, and the insertions since the shard was
+        // last checked for skew.
+        std::atomic<std::size_t> size{0};
+        std::size_t inserts{0};
+    };
+
+    // Upper boundaries of the ranges of the shards but the last one, in increasing order: shard i
+    // holds the keys from boundaries[i - 1] (included) to boundaries[i] (excluded). A layout is
+    // never changed once published; the generation tells it from the previous ones, whose
+    // memory may be reused.
+    struct layout {
+        std::vector<K> boundaries;
+        std::size_t generation{0};
+    };
+
+    // Threads reading a layout without holding a shard lock, counted on one of N cache lines
+    // chosen by thread, so that they do not all write to the same one.
+    struct alignas(64) reader_count {
+        std::atomic<long> count{0};
+    };
+
+    // The locks are taken by const lookups too.
+    mutable std::array<shard, N> _shards;
+    const partitioning _partitioning;
+    const double _skew;
+    const cmp comparator{};
+
+    std::atomic<const layout *> _layout;
+    std::unique_ptr<const layout> _current;
+    mutable std::array<reader_count, N> _readers;
+    std::atomic<std::size_t> _rebalances{0};
+
+    // Insertions into a shard between two checks for skew.
+    static constexpr std::size_t _check_every = 1024;
+
+    std::size_t _shard_of(const K &key, const layout *current) const {
+        if (_partitioning == partitioning::by_hash)
+            return hash{}(key) % N;
+        return std::upper_bound(current->boundaries.begin(), current->boundaries.end(), key,
+                                comparator) -
+               current->boundaries.begin();
+    }
+
+    // The counter of the calling thread.
+    static std::atomic<long> &_reader_count(std::array<reader_count, N> &readers) noexcept {
+        static thread_local const std::size_t slot =
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) % N;
+        return readers[slot].count;
+    }
+
+    // The shard of `key`, locked. With ranges, a rebalance may move the key between the lookup of
+    // its shard and the locking, so the layout is checked again under the lock, where it cannot
+    // change; the lookup is counted among the readers, so that rebalance() does not free the
+    // layout under it.
+    shard &_acquire(const K &key, bool exclusive) const {
+        if (_partitioning == partitioning::by_hash) {
+            shard &s = _shards[_shard_of(key, nullptr)];
+            exclusive ? s.lock.lock() : s.lock.lock_shared();
+            return s;
+        }
+
+        std::atomic<long> &readers = _reader_count(_readers);
+        while (true) {
+            readers.fetch_add(1);
+            const layout *current = _layout.load();
+            const std::size_t generation = current->generation;
+            shard &s = _shards[_shard_of(key, current)];
+            readers.fetch_sub(1, std::memory_order_release);
+
+            exclusive ? s.lock.lock() : s.lock.lock_shared();
+            if (_layout.load(std::memory_order_acquire)->generation == generation)
+                return s;
+            exclusive ? s.lock.unlock() : s.lock.unlock_shared();
+        }
+    }
+
+    struct _shared_guard {
+        rw_lock &lock;
+        ~_shared_guard() { lock.unlock_shared(); }
+    };
+
+    // Whether the largest shard holds more than `_skew` times the average.
+    bool _skewed() const noexcept {
+        std::size_t total = 0, largest = 0;
+        for (const shard &s : _shards) {
+            std::size_t size = s.size.load(std::memory_order_relaxed);
+            total += size;
+            largest = std::max(largest, size);
+        }
+        return largest >= _check_every and largest > _skew * total / N;
+    }
+
+   public:
+    // `skew` must be greater than 1; it only matters for range partitioning.
+    explicit ShardedBTree(partitioning p = partitioning::by_hash, double skew = 2.0)
+        : _partitioning{p}, _skew{skew} {
+        if (skew <= 1)
+            throw std::invalid_argument{"ShardedBTree: the skew must be greater than 1"};
+        _current.reset(new layout{});
+        _layout.store(_current.get());
+        for (shard &s : _shards)
+            s.tree.auto_balance(2);
+    }
+
+    ShardedBTree(const ShardedBTree &) = delete;
+    ShardedBTree &operator=(const ShardedBTree &) = delete;
+
+    bool insert(const K &key, const V &value) {
+        bool check;
+        {
+            shard &s = _acquire(key, true);
+            std::lock_guard<rw_lock> guard{s.lock, std::adopt_lock};
+            s.tree.insert(key, value);
+            check = s.tree.size() > s.size.load(std::memory_order_relaxed) and
+                    ++s.inserts >= _check_every;
+            if (check)
+                s.inserts = 0;
+            s.size.store(s.tree.size(), std::memory_order_relaxed);
+        }
+        if (check and _partitioning == partitioning::by_range and _skewed())
+            rebalance();
+        return true;
+    }
+
+    // Returns whether `key` was present.
+    bool erase(const K &key) {
+        shard &s = _acquire(key, true);
+        std::lock_guard<rw_lock> guard{s.lock, std::adopt_lock};
+        if (s.tree.find(key) == s.tree.end())
+            return false;
+        s.tree.erase(key);
+        s.size.store(s.tree.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    // Copy the value of `key` to `value`, returning whether it is present.
+    bool find(const K &key, V &value) const {
+        shard &s = _acquire(key, false);
+        _shared_guard guard{s.lock};
+        auto it = s.tree.find(key);
+        if (it == s.tree.end())
+            return false;
+        value = it.val();
+        return true;
+    }
+
+    bool contains(const K &key) const {
+        shard &s = _acquire(key, false);
+        _shared_guard guard{s.lock};
+        return s.tree.find(key) != s.tree.end();
+    }
+
+    // Sizes read without locks: exact only while no thread writes.
+    std::size_t size() const noexcept {
+        std::size_t total = 0;
+        for (const shard &s : _shards)
+            total += s.size.load(std::memory_order_relaxed);
+        return total;
+    }
+    std::size_t shard_size(std::size_t i) const noexcept {
+        return _shards[i].size.load(std::memory_order_relaxed);
+    }
+
+    // Move the range boundaries to the quantiles of the keys if the shards are skewed, returning
+    // whether they moved; nothing to do when partitioning by hash.
+    bool rebalance() {
+        if (_partitioning == partitioning::by_hash)
+            return false;
+
+        // In shard order, like ordered(), so that they cannot deadlock.
+        for (shard &s : _shards)
+            s.lock.lock();
+
+        std::unique_ptr<const layout> previous;
+        bool skewed = _skewed();
+        if (skewed) {
+            // The ranges are ordered, so concatenating the shards sorts the keys.
+            std::vector<K> keys;
+            std::vector<V> values;
+            keys.reserve(size());
+            values.reserve(size());
+            for (shard &s : _shards)
+                s.tree.export_sorted(std::back_inserter(keys), std::back_inserter(values));
+
+            std::unique_ptr<layout> next{new layout{}};
+            next->generation = _current->generation + 1;
+            const std::size_t total = keys.size();
+            std::size_t first = 0;
+            for (std::size_t i = 0; i < N; i++) {
+                std::size_t last = (i + 1) * total / N;
+                if (i + 1 < N)
+                    next->boundaries.push_back(keys[last]);
+                _shards[i].tree.assign_sorted(keys.begin() + first, keys.begin() + last,
+                                              values.begin() + first);
+                _shards[i].size.store(last - first, std::memory_order_relaxed);
+                first = last;
+            }
+
+            previous = std::move(_current);
+            _current = std::move(next);
+            _layout.store(_current.get());
+            _rebalances++;
+        }
+
+        for (shard &s : _shards) {
+            s.inserts = 0;
+            s.lock.unlock();
+        }
+
+        // The threads that loaded the previous layout before the store above are done with it
+        // once their counter has been seen at zero; those counted later load the new one. They
+        // never block while counted, so the wait is short.
+        if (previous) {
+            for (reader_count &r : _readers)
+                while (r.count.load() != 0)
+                    std::this_thread::yield();
+        }
+        return skewed;
+    }
+    std::size_t rebalances() const noexcept { return _rebalances.load(); }
+
+    class ordered_view;
+    // All the pairs in key order, merged from the shards, which stay locked for reading while the
+    // view exists: the thread holding it must not write to the tree.
+    ordered_view ordered() const { return ordered_view{*this}; }
+};
+
+template <typename K, typename V, typename cmp, std::size_t N, typename hash>
+class ShardedBTree<K, V, cmp, N, hash>::ordered_view {
+    const ShardedBTree *_owner;
+
+   public:
+    explicit ordered_view(const ShardedBTree &owner) : _owner{&owner} {
+        for (shard &s : _owner->_shards)
+            s.lock.lock_shared();
+    }
+    ~ordered_view() {
+        if (_owner)
+            for (shard &s : _owner->_shards)
+                s.lock.unlock_shared();
+    }
+
+    ordered_view(ordered_view &&other) noexcept : _owner{other._owner} { other._owner = nullptr; }
+    ordered_view(const ordered_view &) = delete;
+    ordered_view &operator=(const ordered_view &) = delete;
+
+    // K-way merge of the shards: a heap of the shards with keys left, by their current key.
+    class iterator {
+        using cursor = typename tree_type::const_iterator;
+        std::vector<std::pair<cursor, cursor>> _cursors;  // current and end of every shard
+        std::vector<std::size_t> _heap;
+
+        // The heap puts the greatest first, so the order is reversed.
+        struct later {
+            const iterator *self;
+            bool operator()(std::size_t a, std::size_t b) const {
+                return cmp{}(self->_cursors[b].first.key(), self->_cursors[a].first.key());
+            }
+        };
+
+       public:
+        explicit iterator(const ShardedBTree *owner) {
+            if (not owner)
+                return;
+            for (std::size_t i = 0; i < N; i++) {
+                const tree_type &tree = owner->_shards[i].tree;
+                _cursors.emplace_back(tree.cbegin(), tree.cend());
+                if (tree.size() > 0)
+                    _heap.push_back(i);
+            }
+            std::make_heap(_heap.begin(), _heap.end(), later{this});
+        }
+
+        const K &key() const noexcept { return _cursors[_heap.front()].first.key(); }
+        const V &val() const noexcept { return _cursors[_heap.front()].first.val(); }
+        const std::pair<K, V> pair() const noexcept { return {key(), val()}; }
+        const V &operator*() const noexcept { return val(); }
+
+        iterator &operator++() {
+            std::pop_heap(_heap.begin(), _heap.end(), later{this});
+            std::pair<cursor, cursor> &c = _cursors[_heap.back()];
+            if (++c.first == c.second)
+                _heap.pop_back();
+            else
+                std::push_heap(_heap.begin(), _heap.end(), later{this});
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const noexcept {
+            if (_heap.empty() or other._heap.empty())
+                return _heap.empty() and other._heap.empty();
+            return _heap.front() == other._heap.front() and
+                   _cursors[_heap.front()].first == other._cursors[_heap.front()].first;
+        }
+        bool operator!=(const iterator &other) const noexcept { return not(*this == other); }
+    };
+
+    iterator begin() const { return iterator{_owner}; }
+    iterator end() const { return iterator{nullptr}; }
+};
+
+#endif
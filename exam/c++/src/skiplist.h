@@ -0,0 +1,573 @@
+#ifndef __SKIPLIST_H__
+#define __SKIPLIST_H__
+
+#include <atomic>
+#include <functional>  // std::less
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "btree.h"  // KeyNotFound
+
+// Ordered map with the same interface as BTree, built as a "lazy" concurrent skip list
+// (Herlihy, Lev, Luchangco, Shavit): lookups and iteration never lock, while `insert` and `erase`
+// only lock the few nodes preceding the key they modify, so writers on different parts of the key
+// space do not contend and no global rebalancing is ever needed.
+//
+// Thread safety: `insert`, `erase`, `find`, `operator[]` and `size` can run concurrently.
+// Overwriting the value of an existing key while another thread reads that same value is a data
+// race unless V is itself atomic. `clear()`, the destructor and moves must not run concurrently
+// with other operations.
+//
+// Memory reclamation: erased nodes are unlinked immediately and freed by a later erase, with
+// epoch-based reclamation. Every operation, and every iterator pointing to a node, pins the
+// current epoch; the epoch advances when no thread is pinned in the previous one, and the nodes
+// unlinked two epochs ago are then out of reach. Without pins, at most the nodes erased in the
+// last two epochs wait to be freed; an iterator kept alive holds back all those erased after it
+// was created, until it is destroyed.
+template <typename K, typename V, typename cmp = std::less<K>>
+class SkipList {
+    static constexpr int max_level = 32;
+
+    class Node;
+
+    class SpinLock {
+        std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+
+       public:
+        void lock() noexcept {
+            while (_flag.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        void unlock() noexcept { _flag.clear(std::memory_order_release); }
+    };
+
+    // The linked part of a node: the head of the list is a tower without key nor value.
+    class Tower {
+       public:
+        const int top_level;
+        std::unique_ptr<std::atomic<Node *>[]> next;
+        std::atomic<bool> marked{false}, fully_linked{false};
+        SpinLock lock;
+
+        explicit Tower(int top) : top_level{top}, next{new std::atomic<Node *>[top + 1]} {
+            for (int level = 0; level <= top; level++)
+                next[level].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    std::unique_ptr<Tower> head{new Tower(max_level - 1)};
+    std::atomic<unsigned int> _size{0};
+    // The unlinked nodes, with the epoch they were unlinked in.
+    std::vector<std::pair<unsigned long, Node *>> retired;
+    std::mutex retired_lock;
+    std::atomic<unsigned long> _epoch{0};
+    // Threads and iterators pinned in the even and in the odd epochs.
+    mutable std::atomic<long> _pinned[2]{{0}, {0}};
+    const cmp comparator;
+
+    // Pin the current epoch, returning it: the nodes reachable from now on are not freed until
+    // _unpin().
+    unsigned long _pin() const noexcept {
+        while (true) {
+            unsigned long epoch = _epoch.load();
+            _pinned[epoch & 1].fetch_add(1);
+            // If the epoch moved meanwhile, the advance may not have seen this pin.
+            if (_epoch.load() == epoch)
+                return epoch;
+            _pinned[epoch & 1].fetch_sub(1);
+        }
+    }
+    void _unpin(unsigned long epoch) const noexcept {
+        _pinned[epoch & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    struct _pin_guard {
+        const SkipList *list;
+        const unsigned long epoch;
+
+        explicit _pin_guard(const SkipList *l) noexcept : list{l}, epoch{l->_pin()} {}
+        ~_pin_guard() { list->_unpin(epoch); }
+    };
+
+    void _retire(Node *node) noexcept;
+
+    static int random_level() noexcept;
+
+    // Fill `preds` and `succs` with the nodes surrounding `key` on every level, returning the
+    // highest level where a node with that key was found, or -1.
+    int _find(const K &key, Tower **preds, Node **succs) const noexcept;
+
+    static void unlock(Tower **preds, int highest_locked) noexcept {
+        Tower *previous = nullptr;
+        for (int level = 0; level <= highest_locked; level++) {
+            if (preds[level] != previous)
+                preds[level]->lock.unlock();
+            previous = preds[level];
+        }
+    }
+
+    Node *_insert(const K &key, const V &value, bool overwrite) noexcept;
+    void _delete_all() noexcept;
+
+   public:
+    SkipList(cmp op = cmp{}) noexcept : comparator{op} {}
+    ~SkipList() noexcept { _delete_all(); }
+
+    unsigned int size() const noexcept { return _size.load(std::memory_order_relaxed); }
+
+    bool insert(const K &key, const V &value) noexcept {
+        _insert(key, value, true);
+        return true;
+    }
+
+    void print() const noexcept;
+    bool clear() noexcept;
+
+    // A skip list is balanced in probability: these only exist so that SkipList can replace BTree.
+    void balance() noexcept {}
+    bool is_balanced() const noexcept { return true; }
+
+    class iterator;
+    class const_iterator;
+    iterator begin() noexcept { return iterator{this}; }
+    iterator end() noexcept { return iterator{this, nullptr}; }
+    const_iterator begin() const noexcept { return cbegin(); }
+    const_iterator end() const noexcept { return cend(); }
+
+    const_iterator cbegin() const noexcept { return const_iterator{this}; }
+    const_iterator cend() const noexcept { return const_iterator{this, nullptr}; }
+
+    iterator find(const K &key) const noexcept;
+    std::pair<K, V> erase(const K &key);
+
+    // Erased nodes not freed yet.
+    std::size_t unreclaimed() noexcept {
+        std::lock_guard<std::mutex> guard{retired_lock};
+        return retired.size();
+    }
+
+    // As for BTree, the reference is invalidated by erasing the key.
+    V &operator[](const K &key) noexcept { return _insert(key, V{}, false)->val(); }
+
+    /* copy ctor */
+    SkipList(const SkipList &other) noexcept : comparator{other.comparator} {
+        for (auto it = other.cbegin(); it != other.cend(); ++it)
+            insert(it.key(), it.val());
+    }
+
+    /* move ctor */
+    SkipList(SkipList &&other) noexcept
+        : head{std::move(other.head)},
+          _size{other._size.load()},
+          retired{std::move(other.retired)},
+          _epoch{other._epoch.load()},
+          comparator{other.comparator} {
+        other.head.reset(new Tower(max_level - 1));
+        other._size = 0;
+    }
+
+    /* copy assignment operator */
+    SkipList &operator=(const SkipList &other) noexcept {
+        SkipList tmp(other);
+        *this = std::move(tmp);
+        return *this;
+    }
+
+    /* move assignment operator */
+    SkipList &operator=(SkipList &&other) noexcept {
+        if (this == &other)
+            return *this;
+
+        _delete_all();
+        head = std::move(other.head);
+        retired = std::move(other.retired);
+        _size = other._size.load();
+        _epoch = other._epoch.load();
+
+        other.head.reset(new Tower(max_level - 1));
+        other.retired.clear();
+        other._size = 0;
+
+        return *this;
+    }
+};
+
+template <typename K, typename V, typename cmp>
+class SkipList<K, V, cmp>::Node : public SkipList<K, V, cmp>::Tower {
+   public:
+    const K _key;
+    V _val;
+
+    Node(const K &key, const V &val, int top) : Tower{top}, _key{key}, _val{val} {}
+
+    const std::pair<K, V> pair() const noexcept { return std::make_pair(_key, _val); }
+    const K &key() const noexcept { return _key; }
+
+    V &val() noexcept { return _val; }
+    const V &val() const noexcept { return _val; }
+};
+
+template <typename K, typename V, typename cmp>
+class SkipList<K, V, cmp>::iterator : public std::iterator<std::forward_iterator_tag, K> {
+    friend class SkipList;
+
+    const SkipList *_list_ref;
+    Node *_current;
+    // The epoch pinned while the iterator may point to a node, so that it is not freed.
+    unsigned long _epoch{0};
+    bool _pinned{false};
+
+    // Skip the nodes that are being inserted or erased by other threads.
+    void _skip_unlinked() noexcept {
+        while (_current and (_current->marked.load(std::memory_order_acquire) or
+                             not _current->fully_linked.load(std::memory_order_acquire)))
+            _current = _current->next[0].load(std::memory_order_acquire);
+    }
+
+   protected:
+    // At `current`, reached while `epoch` was pinned: the iterator pins it too.
+    iterator(const SkipList *list_ref, Node *current, unsigned long epoch) noexcept
+        : _list_ref{list_ref}, _current{current}, _epoch{epoch}, _pinned{true} {
+        _list_ref->_pinned[epoch & 1].fetch_add(1);
+    }
+
+   public:
+    explicit iterator(const SkipList *list_ref) noexcept
+        : _list_ref{list_ref}, _current{nullptr}, _epoch{list_ref->_pin()}, _pinned{true} {
+        _current = list_ref->head->next[0].load(std::memory_order_acquire);
+        _skip_unlinked();
+    }
+    // The end, with `current` null.
+    explicit iterator(const SkipList *list_ref, Node *current) noexcept
+        : _list_ref{list_ref}, _current{current} {}
+
+    iterator(const iterator &other) noexcept
+        : _list_ref{other._list_ref},
+          _current{other._current},
+          _epoch{other._epoch},
+          _pinned{other._pinned} {
+        // The pin of `other` keeps the epoch from advancing twice.
+        if (_pinned)
+            _list_ref->_pinned[_epoch & 1].fetch_add(1);
+    }
+    iterator(iterator &&other) noexcept
+        : _list_ref{other._list_ref},
+          _current{other._current},
+          _epoch{other._epoch},
+          _pinned{other._pinned} {
+        other._pinned = false;
+    }
+    iterator &operator=(iterator other) noexcept {
+        std::swap(_list_ref, other._list_ref);
+        std::swap(_current, other._current);
+        std::swap(_epoch, other._epoch);
+        std::swap(_pinned, other._pinned);
+        return *this;
+    }
+    ~iterator() {
+        if (_pinned)
+            _list_ref->_unpin(_epoch);
+    }
+
+    const K &key() const noexcept { return _current->key(); }
+    V &val() noexcept { return _current->val(); }
+    const V &val() const noexcept { return _current->val(); }
+
+    const std::pair<K, V> pair() const noexcept { return _current->pair(); }
+
+    V &operator*() const noexcept { return _current->val(); }
+
+    // ++it
+    iterator &operator++() noexcept {
+        if (_current) {
+            _current = _current->next[0].load(std::memory_order_acquire);
+            _skip_unlinked();
+        }
+        return *this;
+    }
+
+    // it++
+    iterator operator++(int) noexcept {
+        iterator it{*this};
+        ++(*this);
+        return it;
+    }
+
+    bool operator==(const iterator &other) const noexcept { return _current == other._current; }
+    bool operator!=(const iterator &other) const noexcept { return not(*this == other); }
+};
+
+template <typename K, typename V, typename cmp>
+class SkipList<K, V, cmp>::const_iterator : public SkipList<K, V, cmp>::iterator {
+   public:
+    explicit const_iterator(const SkipList *list_ref) noexcept : iterator{list_ref} {}
+    explicit const_iterator(const SkipList *list_ref, Node *current) noexcept
+        : iterator{list_ref, current} {}
+    const_iterator(const iterator &other) noexcept : iterator{other} {}
+
+    const V &operator*() const noexcept { return SkipList<K, V, cmp>::iterator::operator*(); }
+};
+
+template <typename K, typename V, typename cmp>
+int SkipList<K, V, cmp>::random_level() noexcept {
+    // Per-thread xorshift generator: every level is kept with probability 1/2.
+    thread_local unsigned long long state =
+        std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    int level = 0;
+    unsigned long long bits = state;
+    while ((bits & 1) and level < max_level - 1) {
+        bits >>= 1;
+        level++;
+    }
+    return level;
+}
+
+template <typename K, typename V, typename cmp>
+int SkipList<K, V, cmp>::_find(const K &key, Tower **preds, Node **succs) const noexcept {
+    int found = -1;
+    Tower *pred = head.get();
+
+    for (int level = max_level - 1; level >= 0; level--) {
+        Node *current = pred->next[level].load(std::memory_order_acquire);
+
+        while (current and comparator(current->key(), key)) {
+            pred = current;
+            current = pred->next[level].load(std::memory_order_acquire);
+        }
+
+        if (found == -1 and current and not comparator(key, current->key()))
+            found = level;
+
+        preds[level] = pred;
+        succs[level] = current;
+    }
+
+    return found;
+}
+
+template <typename K, typename V, typename cmp>
+typename SkipList<K, V, cmp>::Node *SkipList<K, V, cmp>::_insert(const K &key,
+                                                                const V &value,
+                                                                bool overwrite) noexcept {
+    _pin_guard pinned{this};
+    const int top_level = random_level();
+    Tower *preds[max_level];
+    Node *succs[max_level];
+
+    while (true) {
+        int found = _find(key, preds, succs);
+
+        if (found != -1) {
+            Node *existing = succs[found];
+
+            if (not existing->marked.load(std::memory_order_acquire)) {
+                // Another thread may still be linking it: wait until it is complete.
+                while (not existing->fully_linked.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                if (overwrite) {
+                    existing->lock.lock();
+                    existing->val() = value;
+                    existing->lock.unlock();
+                }
+                return existing;
+            }
+
+            // The node is being erased: retry once it is gone.
+            continue;
+        }
+
+        // Lock the predecessors bottom-up and check that nothing changed in the meantime.
+        int highest_locked = -1;
+        bool valid = true;
+        Tower *previous = nullptr;
+
+        for (int level = 0; valid and level <= top_level; level++) {
+            Tower *pred = preds[level];
+            Node *succ = succs[level];
+
+            if (pred != previous) {
+                pred->lock.lock();
+                highest_locked = level;
+                previous = pred;
+            }
+
+            valid = not pred->marked.load(std::memory_order_acquire) and
+                    (succ == nullptr or not succ->marked.load(std::memory_order_acquire)) and
+                    pred->next[level].load(std::memory_order_acquire) == succ;
+        }
+
+        if (not valid) {
+            unlock(preds, highest_locked);
+            continue;
+        }
+
+        Node *node = new Node(key, value, top_level);
+        for (int level = 0; level <= top_level; level++)
+            node->next[level].store(succs[level], std::memory_order_relaxed);
+        for (int level = 0; level <= top_level; level++)
+            preds[level]->next[level].store(node, std::memory_order_release);
+
+        node->fully_linked.store(true, std::memory_order_release);
+        unlock(preds, highest_locked);
+
+        _size.fetch_add(1, std::memory_order_relaxed);
+        return node;
+    }
+}
+
+template <typename K, typename V, typename cmp>
+typename SkipList<K, V, cmp>::iterator SkipList<K, V, cmp>::find(const K &key) const noexcept {
+    _pin_guard pinned{this};
+    Tower *preds[max_level];
+    Node *succs[max_level];
+
+    int found = _find(key, preds, succs);
+    if (found != -1 and succs[found]->fully_linked.load(std::memory_order_acquire) and
+        not succs[found]->marked.load(std::memory_order_acquire))
+        return iterator{this, succs[found], pinned.epoch};
+
+    return iterator{this, nullptr};
+}
+
+template <typename K, typename V, typename cmp>
+std::pair<K, V> SkipList<K, V, cmp>::erase(const K &key) {
+    _pin_guard pinned{this};
+    Tower *preds[max_level];
+    Node *succs[max_level];
+    Node *victim = nullptr;
+    bool is_marked = false;
+
+    while (true) {
+        int found = _find(key, preds, succs);
+        if (found != -1)
+            victim = succs[found];
+
+        if (not is_marked and
+            (found == -1 or not victim->fully_linked.load(std::memory_order_acquire) or
+             victim->top_level != found or victim->marked.load(std::memory_order_acquire)))
+            throw KeyNotFound{};
+
+        // Logically remove the node first, so that no other thread can erase it or insert after
+        // it.
+        if (not is_marked) {
+            victim->lock.lock();
+            if (victim->marked.load(std::memory_order_acquire)) {
+                victim->lock.unlock();
+                throw KeyNotFound{};
+            }
+            victim->marked.store(true, std::memory_order_release);
+            is_marked = true;
+        }
+
+        int highest_locked = -1;
+        bool valid = true;
+        Tower *previous = nullptr;
+
+        for (int level = 0; valid and level <= victim->top_level; level++) {
+            Tower *pred = preds[level];
+
+            if (pred != previous) {
+                pred->lock.lock();
+                highest_locked = level;
+                previous = pred;
+            }
+
+            valid = not pred->marked.load(std::memory_order_acquire) and
+                    pred->next[level].load(std::memory_order_acquire) == victim;
+        }
+
+        if (not valid) {
+            unlock(preds, highest_locked);
+            continue;
+        }
+
+        for (int level = victim->top_level; level >= 0; level--)
+            preds[level]->next[level].store(victim->next[level].load(std::memory_order_acquire),
+                                            std::memory_order_release);
+
+        std::pair<K, V> erased = victim->pair();
+        victim->lock.unlock();
+        unlock(preds, highest_locked);
+
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        _retire(victim);
+        return erased;
+    }
+}
+
+template <typename K, typename V, typename cmp>
+void SkipList<K, V, cmp>::_retire(Node *node) noexcept {
+    // Concurrent readers may still be walking through the node: free it two epochs later. The
+    // fence orders the unlinking before the reading of the epoch, and so before any later pin.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::lock_guard<std::mutex> guard{retired_lock};
+    unsigned long epoch = _epoch.load();
+    retired.emplace_back(epoch, node);
+
+    // Advance once no thread is pinned in the previous epoch, which shares the counter of the next.
+    if (_pinned[(epoch + 1) & 1].load() == 0)
+        _epoch.store(++epoch);
+
+    std::size_t reclaimable = 0;
+    while (reclaimable < retired.size() and retired[reclaimable].first + 2 <= epoch)
+        delete retired[reclaimable++].second;
+    retired.erase(retired.begin(), retired.begin() + reclaimable);
+}
+
+template <typename K, typename V, typename cmp>
+void SkipList<K, V, cmp>::_delete_all() noexcept {
+    if (not head)
+        return;
+
+    Node *current = head->next[0].load(std::memory_order_relaxed);
+    while (current) {
+        Node *next = current->next[0].load(std::memory_order_relaxed);
+        delete current;
+        current = next;
+    }
+
+    for (const std::pair<unsigned long, Node *> &node : retired)
+        delete node.second;
+    retired.clear();
+
+    for (int level = 0; level < max_level; level++)
+        head->next[level].store(nullptr, std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename cmp>
+bool SkipList<K, V, cmp>::clear() noexcept {
+    _delete_all();
+    _size = 0;
+    return true;
+}
+
+template <typename K, typename V, typename cmp>
+void SkipList<K, V, cmp>::print() const noexcept {
+    const_iterator it = begin();
+
+    std::cout << "{";
+
+    if (it != end()) {
+        std::cout << "'" << it.key() << "': '" << it.val() << "'";
+        it++;
+    }
+
+    for (; it != end(); ++it) {
+        std::cout << ", '" << it.key() << "': '" << it.val() << "'";
+    }
+
+    std::cout << "}" << std::endl;
+}
+
+#endif
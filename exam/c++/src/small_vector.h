@@ -0,0 +1,179 @@
+#ifndef __SMALL_VECTOR_H__
+#define __SMALL_VECTOR_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "btree_memory.h"
+
+// A vector that keeps up to N elements inside the object itself, and moves them to the heap
+// only when it grows beyond that: a container of a few elements costs no allocation.
+template <typename T, std::size_t N>
+class small_vector {
+    static_assert(N > 0, "small_vector needs room for at least one inline element");
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type _inline[N];
+    T *_data;
+    std::size_t _size{0};
+    std::size_t _capacity{N};
+
+    T *_inline_data() noexcept { return reinterpret_cast<T *>(_inline); }
+
+    // Move the elements to a heap block of `capacity` elements.
+    void _grow(std::size_t capacity) {
+        T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+        for (std::size_t i = 0; i < _size; i++) {
+            new (data + i) T(std::move_if_noexcept(_data[i]));
+            _data[i].~T();
+        }
+        _release();
+        _data = data;
+        _capacity = capacity;
+    }
+
+    void _release() noexcept {
+        if (not is_inline())
+            ::operator delete(_data);
+    }
+
+    void _destroy() noexcept {
+        for (std::size_t i = 0; i < _size; i++)
+            _data[i].~T();
+        _size = 0;
+    }
+
+    // Take the elements of `other`, this being empty and inline: a heap block is stolen, inline
+    // elements are moved one by one.
+    void _take(small_vector &other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (other.is_inline()) {
+            for (T &x : other)
+                new (_data + _size++) T(std::move(x));
+            other._destroy();
+        } else {
+            _data = other._data;
+            _size = other._size;
+            _capacity = other._capacity;
+            other._data = other._inline_data();
+            other._size = 0;
+            other._capacity = N;
+        }
+    }
+
+   public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    small_vector() noexcept : _data{_inline_data()} {}
+
+    small_vector(std::initializer_list<T> values) : small_vector() {
+        reserve(values.size());
+        for (const T &x : values)
+            push_back(x);
+    }
+
+    small_vector(const small_vector &other) : small_vector() {
+        reserve(other._size);
+        for (const T &x : other)
+            push_back(x);
+    }
+
+    small_vector(small_vector &&other) noexcept(std::is_nothrow_move_constructible<T>::value)
+        : small_vector() {
+        _take(other);
+    }
+
+    small_vector &operator=(const small_vector &other) {
+        if (this != &other) {
+            small_vector tmp{other};
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    small_vector &operator=(small_vector &&other) noexcept(
+        std::is_nothrow_move_constructible<T>::value) {
+        if (this != &other) {
+            _destroy();
+            _release();
+            _data = _inline_data();
+            _capacity = N;
+            _take(other);
+        }
+        return *this;
+    }
+
+    ~small_vector() {
+        _destroy();
+        _release();
+    }
+
+    bool is_inline() const noexcept {
+        return _data == reinterpret_cast<const T *>(_inline);
+    }
+
+    std::size_t size() const noexcept { return _size; }
+    std::size_t capacity() const noexcept { return _capacity; }
+    bool empty() const noexcept { return _size == 0; }
+
+    void reserve(std::size_t capacity) {
+        if (capacity > _capacity)
+            _grow(capacity);
+    }
+
+    template <typename... Args>
+    T &emplace_back(Args &&... args) {
+        if (_size == _capacity) {
+            // The arguments may refer to an element, which growing would move.
+            T x(std::forward<Args>(args)...);
+            _grow(2 * _capacity);
+            new (_data + _size) T(std::move(x));
+        } else {
+            new (_data + _size) T(std::forward<Args>(args)...);
+        }
+        return _data[_size++];
+    }
+    void push_back(const T &x) { emplace_back(x); }
+    void push_back(T &&x) { emplace_back(std::move(x)); }
+
+    void pop_back() noexcept { _data[--_size].~T(); }
+    void clear() noexcept { _destroy(); }
+
+    // Remove the element at `position`, keeping the order of the others.
+    iterator erase(const_iterator position) {
+        T *first = _data + (position - _data);
+        std::move(first + 1, end(), first);
+        pop_back();
+        return first;
+    }
+
+    T &operator[](std::size_t i) noexcept { return _data[i]; }
+    const T &operator[](std::size_t i) const noexcept { return _data[i]; }
+    T &front() noexcept { return _data[0]; }
+    const T &front() const noexcept { return _data[0]; }
+    T &back() noexcept { return _data[_size - 1]; }
+    const T &back() const noexcept { return _data[_size - 1]; }
+
+    T *data() noexcept { return _data; }
+    const T *data() const noexcept { return _data; }
+    iterator begin() noexcept { return _data; }
+    iterator end() noexcept { return _data + _size; }
+    const_iterator begin() const noexcept { return _data; }
+    const_iterator end() const noexcept { return _data + _size; }
+};
+
+// Customization point for BTree::memory_usage(): only a spilled vector owns heap memory.
+template <typename T, std::size_t N>
+std::size_t heap_usage(const small_vector<T, N> &v) noexcept {
+    using btree_memory::heap_usage;
+    std::size_t bytes = v.is_inline() ? 0 : v.capacity() * sizeof(T);
+    for (const T &x : v)
+        bytes += heap_usage(x);
+    return bytes;
+}
+
+#endif
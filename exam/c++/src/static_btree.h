@@ -0,0 +1,191 @@
+#ifndef __STATIC_BTREE_H__
+#define __STATIC_BTREE_H__
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+#include "btree.h"  // KeyNotFound
+
+// Immutable map for fixed tables, built by the compiler: a constexpr StaticBTree is a balanced
+// search tree laid out in one array, in breadth-first (Eytzinger) order, where the children of
+// node i are nodes 2i and 2i + 1. The top levels of every lookup share the first cache lines, and
+// there is nothing to build at startup nor to allocate: a constexpr table lives in .rodata.
+//
+//     constexpr auto units = make_static_btree<const char *, double, static_btree::c_string_less>(
+//         {{"cm", 0.01}, {"km", 1000.0}, {"m", 1.0}, {"mm", 0.001}});
+//     static_assert(units["km"] == 1000.0, "looked up at compile time");
+//
+// The entries must be given in increasing key order, without duplicates: the order is checked
+// while building, which fails to compile when it is evaluated at compile time. Lookups are
+// constexpr too; the iteration is in key order, like that of BTree.
+namespace static_btree {
+
+    // std::less, whose call operator is constexpr only from C++14.
+    struct less {
+        template <typename T>
+        constexpr bool operator()(const T &a, const T &b) const {
+            return a < b;
+        }
+    };
+
+    // C strings by their characters, where std::less would compare the pointers.
+    struct c_string_less {
+        constexpr bool operator()(const char *a, const char *b) const {
+            return *a != *b ? static_cast<unsigned char>(*a) < static_cast<unsigned char>(*b)
+                            : *a != '\0' and (*this)(a + 1, b + 1);
+        }
+    };
+
+    // The pack 0, ..., N - 1, as std::index_sequence is C++14; built in log(N) steps, so that
+    // large tables stay within the template depth limit.
+    template <std::size_t... I>
+    struct indices {};
+
+    template <typename A, typename B>
+    struct concat;
+    template <std::size_t... I, std::size_t... J>
+    struct concat<indices<I...>, indices<J...>> {
+        using type = indices<I..., (sizeof...(I) + J)...>;
+    };
+
+    template <std::size_t N>
+    struct make_indices {
+        using type = typename concat<typename make_indices<N / 2>::type,
+                                     typename make_indices<N - N / 2>::type>::type;
+    };
+    template <>
+    struct make_indices<0> {
+        using type = indices<>;
+    };
+    template <>
+    struct make_indices<1> {
+        using type = indices<0>;
+    };
+
+    // Functions of the nodes of a complete tree of n nodes in breadth-first order, from 1, in the
+    // single return statement of C++11 constexpr functions.
+    constexpr std::size_t log2(std::size_t n) { return n < 2 ? 0 : 1 + log2(n / 2); }
+
+    constexpr std::size_t min(std::size_t a, std::size_t b) { return a < b ? a : b; }
+
+    // The nodes in the subtree of node i, `h` levels above the last one: full levels but for the
+    // last, where only those up to n exist.
+    constexpr std::size_t subtree(std::size_t i, std::size_t n, std::size_t h) {
+        return (std::size_t{1} << h) - 1 +
+               (n < (i << h) ? 0 : min(n - (i << h) + 1, std::size_t{1} << h));
+    }
+    constexpr std::size_t subtree(std::size_t i, std::size_t n) {
+        return i > n ? 0 : subtree(i, n, log2(n) - log2(i));
+    }
+
+    // The position of node i in key order: the nodes of its left subtree come before it, and so
+    // do, for every ancestor it descends from on the right, that ancestor and its left subtree.
+    constexpr std::size_t preceding(std::size_t i, std::size_t n) {
+        return i == 1 ? 0 : (i % 2 == 1 ? subtree(i - 1, n) + 1 : 0) + preceding(i / 2, n);
+    }
+    constexpr std::size_t rank(std::size_t i, std::size_t n) {
+        return subtree(2 * i, n) + preceding(i, n);
+    }
+}
+
+template <typename K, typename V, std::size_t N, typename cmp = static_btree::less>
+class StaticBTree {
+    static_assert(N > 0, "StaticBTree needs at least one entry");
+
+    // Node i is _entries[i - 1]; node 0 stands for the end.
+    const std::pair<K, V> _entries[N];
+
+    template <std::size_t... I>
+    constexpr StaticBTree(const std::pair<K, V> (&sorted)[N], static_btree::indices<I...>)
+        : _entries{_checked(sorted, static_btree::rank(I + 1, N))...} {}
+
+    // sorted[r], checked to follow sorted[r - 1]; a throw stops a compile-time evaluation.
+    static constexpr const std::pair<K, V> &_checked(const std::pair<K, V> (&sorted)[N],
+                                                     std::size_t r) {
+        return r == 0 or cmp{}(sorted[r - 1].first, sorted[r].first)
+                   ? sorted[r]
+                   : throw std::invalid_argument{"StaticBTree: the keys must be sorted and unique"};
+    }
+
+    constexpr std::size_t _find(const K &key, std::size_t i) const noexcept {
+        return i > N ? 0
+                     : cmp{}(key, _entries[i - 1].first)
+                           ? _find(key, 2 * i)
+                           : cmp{}(_entries[i - 1].first, key) ? _find(key, 2 * i + 1) : i;
+    }
+    constexpr std::size_t _leftmost(std::size_t i) const noexcept {
+        return 2 * i > N ? i : _leftmost(2 * i);
+    }
+    constexpr const V &_value(std::size_t i) const {
+        return i ? _entries[i - 1].second : throw KeyNotFound{};
+    }
+
+   public:
+    using key_type = K;
+    using value_type = V;
+
+    // `sorted` in increasing key order.
+    constexpr explicit StaticBTree(const std::pair<K, V> (&sorted)[N])
+        : StaticBTree{sorted, typename static_btree::make_indices<N>::type{}} {}
+
+    class iterator {
+        const StaticBTree *_tree;
+        std::size_t _node;
+
+       public:
+        constexpr iterator(const StaticBTree *tree, std::size_t node) noexcept
+            : _tree{tree}, _node{node} {}
+
+        constexpr const K &key() const noexcept { return _tree->_entries[_node - 1].first; }
+        constexpr const V &val() const noexcept { return _tree->_entries[_node - 1].second; }
+        constexpr const std::pair<K, V> &pair() const noexcept {
+            return _tree->_entries[_node - 1];
+        }
+        constexpr const V &operator*() const noexcept { return val(); }
+
+        // The leftmost node of the right subtree, or the first ancestor reached from the left.
+        iterator &operator++() noexcept {
+            if (2 * _node + 1 <= N) {
+                _node = 2 * _node + 1;
+                while (2 * _node <= N)
+                    _node *= 2;
+            } else {
+                while (_node % 2 == 1)
+                    _node /= 2;
+                _node /= 2;
+            }
+            return *this;
+        }
+
+        constexpr bool operator==(const iterator &other) const noexcept {
+            return _node == other._node;
+        }
+        constexpr bool operator!=(const iterator &other) const noexcept {
+            return not(*this == other);
+        }
+    };
+    using const_iterator = iterator;
+
+    constexpr iterator begin() const noexcept { return iterator{this, _leftmost(1)}; }
+    constexpr iterator end() const noexcept { return iterator{this, 0}; }
+    constexpr iterator cbegin() const noexcept { return begin(); }
+    constexpr iterator cend() const noexcept { return end(); }
+
+    constexpr iterator find(const K &key) const noexcept { return iterator{this, _find(key, 1)}; }
+    constexpr bool contains(const K &key) const noexcept { return _find(key, 1) != 0; }
+
+    // Throws KeyNotFound if `key` is missing.
+    constexpr const V &operator[](const K &key) const { return _value(_find(key, 1)); }
+
+    constexpr std::size_t size() const noexcept { return N; }
+};
+
+// Deduces the size of the table from the entries, e.g.
+// `make_static_btree<int, const char *>({{1, "EPERM"}, {2, "ENOENT"}})`.
+template <typename K, typename V, typename cmp = static_btree::less, std::size_t N>
+constexpr StaticBTree<K, V, N, cmp> make_static_btree(const std::pair<K, V> (&sorted)[N]) {
+    return StaticBTree<K, V, N, cmp>{sorted};
+}
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef __STRING_BTREE_H__
+#define __STRING_BTREE_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+// Reference to a key stored in the arena of a StringBTree: its first `prefix_length` characters
+// are shared with another key, at `prefix`, and the rest is its own, at `suffix`. Offsets are
+// 32-bit, so that the whole key takes 16 bytes in the node, against 32 for a std::string.
+struct string_key {
+    std::uint32_t prefix;
+    std::uint32_t prefix_length;
+    std::uint32_t suffix;
+    std::uint32_t suffix_length;
+
+    std::size_t length() const noexcept { return std::size_t(prefix_length) + suffix_length; }
+
+    unsigned char at(const char *arena, std::size_t i) const noexcept {
+        return i < prefix_length ? arena[prefix + i] : arena[suffix + i - prefix_length];
+    }
+
+    std::string str(const char *arena) const {
+        std::string s(arena + prefix, prefix_length);
+        s.append(arena + suffix, suffix_length);
+        return s;
+    }
+};
+
+// Ordered map from strings to V, for sets of keys with long shared prefixes, such as URLs.
+//
+// The characters of the keys live in a single arena instead of one heap block per key, and a new
+// key shares the longest prefix it can with the closest key already stored: the arena grows only
+// by the part that is new. Lookups skip the prefix known to be common: going down the tree the
+// key is bracketed by the closest smaller and greater keys visited, and every key below shares
+// with it at least the shorter of the two common prefixes, so the comparison starts after it.
+//
+// Erased keys leave their characters in the arena, since other keys may share them; compact()
+// rewrites the arena with only the live keys.
+template <typename V, typename stats_policy = btree_stats::none>
+class StringBTree {
+    // Orders the stored keys; it holds the address of the arena of its StringBTree, so the tree
+    // is never copied nor moved together with its comparator.
+    struct arena_less {
+        const std::vector<char> *arena;
+        bool operator()(const string_key &a, const string_key &b) const noexcept {
+            return _compare(arena->data(), a, b) < 0;
+        }
+    };
+
+   public:
+    using tree_type = BTree<string_key, V, arena_less, stats_policy>;
+
+   private:
+    std::vector<char> _arena;
+    std::size_t _garbage{0};
+    tree_type _tree;
+
+    // Three-way comparison of two stored keys. Keys sharing the same prefix are compared from
+    // its end.
+    static int _compare(const char *arena, const string_key &a, const string_key &b) noexcept {
+        std::size_t i = a.prefix == b.prefix ? std::min(a.prefix_length, b.prefix_length) : 0;
+        const std::size_t n = std::min(a.length(), b.length());
+        while (i < n and a.at(arena, i) == b.at(arena, i))
+            i++;
+        if (i < n)
+            return a.at(arena, i) < b.at(arena, i) ? -1 : 1;
+        return a.length() < b.length() ? -1 : a.length() > b.length();
+    }
+
+    // Three-way comparison of `query` with a stored key, knowing that their first `lcp`
+    // characters are equal; `lcp` receives the length of their longest common prefix.
+    static int _compare_from(const char *arena,
+                             const std::string &query,
+                             const string_key &key,
+                             std::size_t &lcp) noexcept {
+        const std::size_t length = key.length();
+        const std::size_t n = std::min(query.size(), length);
+        std::size_t i = lcp;
+
+        const char *prefix = arena + key.prefix;
+        const std::size_t in_prefix = std::min<std::size_t>(n, key.prefix_length);
+        while (i < in_prefix and query[i] == prefix[i])
+            i++;
+        if (i < key.prefix_length and i < n) {
+            lcp = i;
+            return (unsigned char)query[i] < (unsigned char)prefix[i] ? -1 : 1;
+        }
+
+        const char *suffix = arena + key.suffix;
+        while (i < n and query[i] == suffix[i - key.prefix_length])
+            i++;
+        lcp = i;
+        if (i < n)
+            return (unsigned char)query[i] < (unsigned char)suffix[i - key.prefix_length] ? -1 : 1;
+        return query.size() < length ? -1 : query.size() > length;
+    }
+
+    // Probe for tree_type::find_with(). It also remembers the visited key sharing the longest
+    // prefix with the query: both neighbours of a missing key are on the path, so it is the
+    // best one to share characters with.
+    struct _probe {
+        const char *arena;
+        const std::string &query;
+        std::size_t lower_lcp{0}, upper_lcp{0};
+        const string_key *nearest{nullptr};
+        std::size_t nearest_lcp{0};
+
+        _probe(const char *arena, const std::string &query) noexcept
+            : arena{arena}, query{query} {}
+
+        int operator()(const string_key &key) noexcept {
+            std::size_t lcp = std::min(lower_lcp, upper_lcp);
+            int order = _compare_from(arena, query, key, lcp);
+            (order < 0 ? upper_lcp : lower_lcp) = lcp;
+            if (not nearest or lcp > nearest_lcp) {
+                nearest = &key;
+                nearest_lcp = lcp;
+            }
+            return order;
+        }
+    };
+
+    // How many of the `lcp` characters a new key has in common with `nearest` it can share: all
+    // of them if `nearest` is contiguous, otherwise those of its own shared prefix.
+    static std::size_t _shareable(const string_key &nearest, std::size_t lcp) noexcept {
+        return nearest.prefix_length == 0 ? lcp
+                                          : std::min<std::size_t>(lcp, nearest.prefix_length);
+    }
+
+    // Append `key` to `arena`, sharing what it can of its first `lcp` characters with `nearest`
+    // (if any).
+    static string_key _append(std::vector<char> &arena,
+                              const std::string &key,
+                              const string_key *nearest,
+                              std::size_t lcp) {
+        string_key stored{0, 0, 0, 0};
+        if (nearest) {
+            stored.prefix = nearest->prefix_length == 0 ? nearest->suffix : nearest->prefix;
+            stored.prefix_length = _shareable(*nearest, lcp);
+        }
+
+        const std::size_t own = key.size() - stored.prefix_length;
+        if (arena.size() + own > std::numeric_limits<std::uint32_t>::max())
+            throw std::length_error{"StringBTree: the key arena is limited to 4 GiB"};
+
+        stored.suffix = arena.size();
+        stored.suffix_length = own;
+        arena.insert(arena.end(), key.begin() + stored.prefix_length, key.end());
+        return stored;
+    }
+
+    // Call f(key, lcp, value) on the live keys in key order, where `lcp` is the length of the
+    // prefix `key` has in common with the previous one.
+    template <typename F>
+    void _for_each_sorted(F f) const {
+        std::string previous;
+        for (auto it = _tree.cbegin(); it != _tree.cend(); ++it) {
+            std::string key = it.key().str(_arena.data());
+            std::size_t common = std::min(previous.size(), key.size());
+            std::size_t lcp =
+                std::mismatch(key.begin(), key.begin() + common, previous.begin()).first -
+                key.begin();
+
+            f(key, lcp, it.val());
+            previous = std::move(key);
+        }
+    }
+
+   public:
+    using key_type = std::string;
+    using value_type = V;
+
+    class iterator {
+        const StringBTree *_owner;
+        typename tree_type::iterator _node;
+
+       public:
+        iterator(const StringBTree *owner, typename tree_type::iterator node) noexcept
+            : _owner{owner}, _node{node} {}
+
+        // Keys are rebuilt from the arena, so they are returned by value.
+        std::string key() const { return _node.key().str(_owner->_arena.data()); }
+        V &val() noexcept { return _node.val(); }
+        const V &val() const noexcept { return _node.val(); }
+        V &operator*() const noexcept { return *_node; }
+
+        iterator &operator++() noexcept {
+            ++_node;
+            return *this;
+        }
+        iterator operator++(int) noexcept {
+            iterator it{*this};
+            ++_node;
+            return it;
+        }
+
+        bool operator==(const iterator &other) const noexcept { return _node == other._node; }
+        bool operator!=(const iterator &other) const noexcept { return _node != other._node; }
+    };
+
+    StringBTree() : _tree{arena_less{&_arena}} {}
+
+    /* copy ctor */
+    StringBTree(const StringBTree &other) : StringBTree() { *this = other; }
+
+    /* move ctor */
+    StringBTree(StringBTree &&other) noexcept : StringBTree() { *this = std::move(other); }
+
+    /* copy assignment operator */
+    StringBTree &operator=(const StringBTree &other) {
+        if (this != &other) {
+            // The copied tree still points to the arena of `other`, but it is only moved here,
+            // where the comparator of this tree is kept.
+            tree_type tree{other._tree};
+            _arena = other._arena;
+            _garbage = other._garbage;
+            _tree = std::move(tree);
+        }
+        return *this;
+    }
+
+    /* move assignment operator */
+    StringBTree &operator=(StringBTree &&other) noexcept {
+        if (this != &other) {
+            _arena = std::move(other._arena);
+            _garbage = other._garbage;
+            _tree = std::move(other._tree);
+            other._arena.clear();
+            other._garbage = 0;
+        }
+        return *this;
+    }
+
+    const unsigned int &size() const noexcept { return _tree.size(); }
+
+    // Insert or overwrite, like BTree::insert; a new key costs a second descent to link it.
+    bool insert(const std::string &key, const V &value) {
+        _probe probe{_arena.data(), key};
+        auto it = _tree.find_with(probe);
+        if (it != _tree.end()) {
+            it.val() = value;
+            return true;
+        }
+        return _tree.insert(_append(_arena, key, probe.nearest, probe.nearest_lcp), value);
+    }
+
+    iterator find(const std::string &key) const noexcept {
+        _probe probe{_arena.data(), key};
+        return iterator{this, _tree.find_with(probe)};
+    }
+
+    bool contains(const std::string &key) const noexcept { return find(key) != end(); }
+
+    // Inserts a default value for a missing key, as BTree::operator[].
+    V &operator[](const std::string &key) {
+        _probe probe{_arena.data(), key};
+        auto it = _tree.find_with(probe);
+        if (it != _tree.end())
+            return it.val();
+        return _tree[_append(_arena, key, probe.nearest, probe.nearest_lcp)];
+    }
+
+    // Throws KeyNotFound for a missing key.
+    const V &operator[](const std::string &key) const {
+        iterator it = find(key);
+        if (it == end())
+            throw KeyNotFound{};
+        return it.val();
+    }
+
+    // Remove `key`, returning its pair; throws KeyNotFound for a missing key, as BTree::erase.
+    std::pair<std::string, V> erase(const std::string &key) {
+        _probe probe{_arena.data(), key};
+        auto it = _tree.find_with(probe);
+        if (it == _tree.end())
+            throw KeyNotFound{};
+
+        const string_key stored = it.key();
+        std::pair<string_key, V> erased = _tree.erase(stored);
+        _garbage += stored.suffix_length;
+        return {key, std::move(erased.second)};
+    }
+
+    void clear() noexcept {
+        _tree.clear();
+        _arena.clear();
+        _garbage = 0;
+    }
+
+    iterator begin() const noexcept { return iterator{this, _tree.cbegin()}; }
+    iterator end() const noexcept { return iterator{this, _tree.cend()}; }
+
+    void balance() noexcept { _tree.balance(); }
+    void auto_balance(double factor) noexcept { _tree.auto_balance(factor); }
+    unsigned int height() const noexcept { return _tree.height(); }
+
+    // Characters in the arena, and the characters stored by erased keys: an upper bound on what
+    // compact() reclaims, since some of them may still be the prefix of live keys.
+    std::size_t arena_size() const noexcept { return _arena.size(); }
+    std::size_t garbage() const noexcept { return _garbage; }
+
+    // Rewrite the arena with the live keys only, in key order, each sharing its prefix with the
+    // previous one, and rebuild a balanced tree on them.
+    void compact() {
+        std::vector<string_key> keys;
+        std::vector<V> values;
+        std::vector<char> arena;
+        keys.reserve(size());
+        values.reserve(size());
+
+        // A first pass sizes the new arena, which is then allocated once: each key adds what it
+        // cannot share with the previous one.
+        std::size_t characters = 0;
+        string_key previous{0, 0, 0, 0};
+        _for_each_sorted([&](const std::string &key, std::size_t lcp, const V &) {
+            previous.prefix_length = _shareable(previous, lcp);
+            characters += key.size() - previous.prefix_length;
+        });
+        arena.reserve(characters);
+
+        _for_each_sorted([&](const std::string &key, std::size_t lcp, const V &value) {
+            keys.push_back(_append(arena, key, keys.empty() ? nullptr : &keys.back(), lcp));
+            values.push_back(value);
+        });
+
+        // The comparator reads the arena of this tree, so it must be in place before the build.
+        _arena.swap(arena);
+        _garbage = 0;
+        _tree.assign_sorted(keys.begin(), keys.end(), values.begin());
+    }
+
+    // The nodes, with their 16-byte keys, plus the arena as the heap owned by the keys.
+    btree_memory::usage memory_usage() const noexcept {
+        btree_memory::usage usage = _tree.memory_usage();
+        usage.object = sizeof(*this);
+        usage.heap += _arena.capacity();
+        return usage;
+    }
+
+    // The underlying tree, e.g. for its statistics.
+    const tree_type &tree() const noexcept { return _tree; }
+};
+
+#endif
@@ -1,7 +1,26 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#ifdef DEBUG
+#define ALLOC_COUNTER_IMPLEMENT
+#endif
+#include "alloc_counter.h"
 #include "btree.h"
+#include "btree_cache.h"
+#include "btree_multimap.h"
+#include "btree_wal.h"
+#include "radix.h"
+#include "rw_lock.h"
+#include "sharded_btree.h"
+#include "static_btree.h"
+#include "skiplist.h"
+#include "string_btree.h"
+#include "versioned_btree.h"
 #include "doctest.h"
+#include <cstdlib>  // mkdtemp
+#include <fstream>
+#include <map>
 #include <numeric>  // std::accumulate
+#include <random>
+#include <thread>
 
 // In doctest, there are three kind of assertion macros: REQUIRE, CHECK and WARN.
 // If a REQUIRE fails, it stops the whole test execution, if a CHECK fails, the tests continue to
@@ -170,6 +189,123 @@ TEST_CASE("tree balancing") {
     }
 }
 
+TEST_CASE("automatic scapegoat rebalancing") {
+    BTree<int, int, std::less<int>> tree;
+    tree.auto_balance(2.0);
+    REQUIRE(tree.auto_balance() == doctest::Approx(2.0));
+
+    // Sorted insertions degenerate a plain tree into a list.
+    for (int i = 0; i < 1000; i++) {
+        tree.insert(i, -i);
+        REQUIRE(tree.height() <= 2.0 * std::log2(tree.size()) + 1);
+    }
+
+    REQUIRE(tree.size() == 1000);
+    REQUIRE(tree.traversal_size() == 1000);
+
+    int expected = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it, ++expected) {
+        CHECK(it.key() == expected);
+        CHECK(it.val() == -expected);
+    }
+    CHECK(expected == 1000);
+
+    SUBCASE("disabling it") {
+        tree.auto_balance(0);
+        for (int i = 1000; i < 1100; i++)
+            tree.insert(i, -i);
+        CHECK(tree.height() > 100);
+    }
+}
+
+TEST_CASE("incremental balancing") {
+    BTree<int, int, std::less<int>> tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 2000; i++) {
+        tree.insert(i, i);
+        expected[i] = i;
+    }
+    REQUIRE(tree.height() == 2000);
+
+    auto same_contents = [&]() {
+        REQUIRE(tree.audit() == "");
+        REQUIRE(tree.size() == expected.size());
+        auto it = tree.cbegin();
+        for (const std::pair<const int, int> &pair : expected) {
+            REQUIRE(it.key() == pair.first);
+            CHECK(it.val() == pair.second);
+            ++it;
+        }
+    };
+
+    SUBCASE("steps interleaved with writes") {
+        std::mt19937 generator{7};
+        unsigned int steps = 0;
+        while (not tree.balance_step(100)) {
+            steps++;
+            CHECK(tree.rebalancing());
+
+            // Writes on both sides of the copy cursor, in every phase.
+            int key = generator() % 2500;
+            tree.insert(key, -key);
+            expected[key] = -key;
+            tree[key + 1] = steps;
+            expected[key + 1] = steps;
+            key = generator() % 2500;
+            if (tree.find(key) != tree.end()) {
+                tree.erase(key);
+                expected.erase(key);
+            }
+            CHECK(tree.find(1000) != tree.end());  // reads see the live tree
+        }
+        CHECK(steps > 40);  // copying, linking and freeing 2000 nodes
+        CHECK(not tree.rebalancing());
+        same_contents();
+        CHECK(tree.height() < 2 * std::log2(tree.size()));
+    }
+
+    SUBCASE("memory usage counts the tree being built") {
+        const std::size_t nodes = tree.memory_usage().nodes;
+        tree.balance_step(1000);  // copies half of the nodes
+        CHECK(tree.memory_usage().nodes == nodes / 2 * 3);
+        CHECK(tree.memory_usage().heap == 0);
+
+        tree.insert(2000, 0);  // also remembered, to be replayed
+        btree_memory::usage usage = tree.memory_usage();
+        CHECK(usage.nodes == nodes / 2000 * (2001 + 1000));
+        CHECK(usage.heap >= sizeof(int));
+
+        while (not tree.balance_step(100))
+            REQUIRE(tree.memory_usage().nodes > nodes / 2000 * 2001);
+        CHECK(tree.memory_usage().nodes == nodes / 2000 * 2001);
+        CHECK(tree.memory_usage().heap == 0);
+    }
+
+    SUBCASE("a time budget") {
+        while (not tree.balance_step(std::chrono::microseconds{50})) {
+        }
+        same_contents();
+        CHECK(tree.height() == 11);  // ceil(log2(2001))
+    }
+
+    SUBCASE("moved, cleared and empty trees") {
+        for (int i = 0; i < 5; i++)
+            tree.balance_step(300);
+        BTree<int, int, std::less<int>> moved{std::move(tree)};
+        CHECK(moved.rebalancing());
+        while (not moved.balance_step(300)) {
+        }
+        CHECK(moved.height() == 11);
+        CHECK(moved.size() == 2000);
+
+        moved.balance_step(300);
+        moved.clear();
+        CHECK(not moved.rebalancing());
+        CHECK(moved.balance_step(1));
+        CHECK(moved.size() == 0);
+    }
+}
+
 TEST_CASE("iterator basic test") {
     BTree<int, float, std::less<int>> tree;
 
@@ -325,6 +461,75 @@ TEST_CASE("find method with iterator") {
     }
 }
 
+TEST_CASE("interleaved lookups") {
+    using Tree = BTree<int, int, std::less<int>, btree_stats::counting>;
+    Tree tree;
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; i++)
+        keys.push_back((i * 7919) % 2000);  // half of them hit
+    for (int i = 0; i < 1000; i += 2)
+        tree.insert(i * 2, -i);
+
+    auto check_batch = [&](std::vector<Tree::iterator> &results) {
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            REQUIRE(results[i] == tree.find(keys[i]));
+            if (results[i] != tree.end())
+                CHECK(results[i].key() == keys[i]);
+        }
+    };
+
+    std::vector<Tree::iterator> results(keys.size(), tree.begin());
+    tree.reset_stats();
+    tree.find_interleaved(keys.begin(), keys.end(), results.begin());
+    CHECK(tree.stats().lookups == keys.size());
+    check_batch(results);
+
+    tree.balance();
+    tree.find_interleaved<1>(keys.begin(), keys.end(), results.begin());
+    check_batch(results);
+    tree.find_interleaved<64>(keys.begin(), keys.end(), results.begin());
+    check_batch(results);
+
+    // Fewer keys than lookups at once, and an empty tree.
+    tree.find_interleaved(keys.begin(), keys.begin() + 3, results.begin());
+    CHECK(results[1] == tree.find(keys[1]));
+    Tree empty;
+    std::vector<Tree::iterator> none(3, tree.begin());
+    empty.find_interleaved(keys.begin(), keys.begin() + 3, none.begin());
+    CHECK(none[0] == empty.end());
+    CHECK(none[2] == empty.end());
+}
+
+TEST_CASE("lower_bound and upper_bound") {
+    BTree<int, float, std::less<int>> tree;
+    int keys[] = {18, 28, 8, 12, 4, 10, 24, 14, 6, 2, 16, 22, 20, 30, 26};
+    for (int i = 0; i < 15; i++)
+        tree.insert(keys[i], keys[i]);
+
+    CHECK(tree.lower_bound(12).key() == 12);
+    CHECK(tree.upper_bound(12).key() == 14);
+    CHECK(tree.lower_bound(13).key() == 14);
+    CHECK(tree.upper_bound(13).key() == 14);
+    CHECK(tree.lower_bound(0).key() == 2);
+    CHECK((tree.lower_bound(31) == tree.end()));
+    CHECK((tree.upper_bound(30) == tree.end()));
+
+    SUBCASE("range iteration") {
+        int count = 0, expected = 10;
+        for (auto it = tree.lower_bound(9); it != tree.lower_bound(21); ++it, expected += 2) {
+            CHECK(it.key() == expected);
+            count++;
+        }
+        CHECK(count == 6);
+    }
+
+    SUBCASE("empty tree") {
+        BTree<int, float, std::less<int>> empty;
+        CHECK((empty.lower_bound(1) == empty.end()));
+        CHECK((empty.upper_bound(1) == empty.end()));
+    }
+}
+
 TEST_CASE("more thorough test on iterators") {
     BTree<int, double, std::less<int>> tree;
 
@@ -462,6 +667,19 @@ TEST_CASE("erase method") {
     }
 
     SUBCASE("erase missing key") { REQUIRE_THROWS_AS(tree.erase(999999), KeyNotFound); }
+
+    SUBCASE("erase nodes with two children") {
+        tree.balance();
+        REQUIRE(tree.height() == 4);
+
+        // The root and its children in the balanced tree: their successors take their place.
+        for (int key : {8, 4, 12}) {
+            CHECK(tree.erase(key).first == key);
+            CHECK(tree.audit() == "");
+            CHECK(tree.height() == 4);
+        }
+        CHECK(tree.size() == 12);
+    }
 }
 
 TEST_CASE("erase method limit cases") {
@@ -494,6 +712,21 @@ TEST_CASE("square brackets operator") {
         for (int i = 0; i < 15; i++)
             CHECK(tree[keys[i]] == doctest::Approx(keys[i]));
     }
+
+    SUBCASE("a missing key is inserted with the default value") {
+        float &value = tree[42];
+        CHECK(value == 0);
+        value = 4.2;
+        CHECK(tree.size() == 16);
+        CHECK(*tree.find(42) == doctest::Approx(4.2));
+    }
+
+    SUBCASE("the const version throws on a missing key") {
+        const BTree<int, float, std::less<int>> &const_tree = tree;
+        CHECK(const_tree[9] == doctest::Approx(9));
+        CHECK_THROWS_AS(const_tree[42], KeyNotFound);
+        CHECK(tree.size() == 15);
+    }
 }
 
 TEST_CASE("copy/move semantics") {
@@ -564,6 +797,1281 @@ TEST_CASE("height method + some constant methods") {
     }
 }
 
+TEST_CASE("cached height") {
+    BTree<int, int, std::less<int>> tree;
+    int keys[] = {9, 14, 4, 6, 2, 5, 12, 7, 3, 1, 8, 11, 10, 15, 13};
+
+    for (int i = 0; i < 15; i++) {
+        tree.insert(keys[i], keys[i]);
+        REQUIRE(tree.height() == tree.audit_height());
+    }
+
+    SUBCASE("erase") {
+        for (int i = 0; i < 15; i++) {
+            tree.erase(keys[(i * 7) % 15]);
+            REQUIRE(tree.height() == tree.audit_height());
+        }
+        CHECK(tree.height() == 0);
+    }
+
+    SUBCASE("balance and clear") {
+        tree.balance();
+        CHECK(tree.height() == tree.audit_height());
+        CHECK(tree.is_balanced());
+
+        tree.clear();
+        CHECK(tree.height() == 0);
+        CHECK(tree.audit_height() == 0);
+    }
+
+    SUBCASE("automatic rebalancing") {
+        tree.auto_balance(1.5);
+        for (int i = 100; i < 300; i++) {
+            tree.insert(i, i);
+            REQUIRE(tree.height() == tree.audit_height());
+        }
+    }
+
+    SUBCASE("copy and move") {
+        BTree<int, int, std::less<int>> copy{tree};
+        CHECK(copy.height() == copy.audit_height());
+
+        BTree<int, int, std::less<int>> moved{std::move(tree)};
+        CHECK(moved.height() == moved.audit_height());
+        CHECK(tree.height() == 0);
+    }
+}
+
+TEST_CASE("bulk loading and serialization") {
+    BTree<int, double, std::less<int>> tree;
+    std::vector<int> keys;
+    std::vector<double> values;
+    for (int i = -500; i < 500; i += 5) {
+        keys.push_back(i);
+        values.push_back(i / 2.0);
+    }
+
+    tree.insert(1, 1);
+    tree.assign_sorted(keys.begin(), keys.end(), values.begin());
+    REQUIRE(tree.size() == keys.size());
+    CHECK(tree.is_balanced());
+    CHECK(tree.height() == tree.audit_height());
+    CHECK((tree.find(1) == tree.end()));
+    CHECK(tree.find(-250).val() == -125.0);
+
+    SUBCASE("export in key order") {
+        std::vector<int> exported_keys;
+        std::vector<double> exported_values;
+        tree.export_sorted(std::back_inserter(exported_keys), std::back_inserter(exported_values));
+        CHECK(exported_keys == keys);
+        CHECK(exported_values == values);
+    }
+
+    SUBCASE("unsorted keys are rejected") {
+        std::swap(keys[3], keys[4]);
+        CHECK_THROWS_AS(tree.assign_sorted(keys.begin(), keys.end(), values.begin()),
+                        std::invalid_argument);
+        keys[4] = keys[3];
+        CHECK_THROWS_AS(tree.assign_sorted(keys.begin(), keys.end(), values.begin()),
+                        std::invalid_argument);
+        CHECK(tree.size() == keys.size());
+    }
+
+    SUBCASE("serialize and deserialize") {
+        std::vector<char> buffer(tree.serialized_size());
+        tree.serialize(buffer.data());
+
+        BTree<int, double, std::less<int>> copy;
+        copy.deserialize(buffer.data(), buffer.size());
+        REQUIRE(copy.size() == tree.size());
+        CHECK(copy.is_balanced());
+        for (auto it = tree.cbegin(), other = copy.cbegin(); it != tree.cend(); ++it, ++other) {
+            CHECK(it.key() == other.key());
+            CHECK(it.val() == other.val());
+        }
+
+        BTree<int, float, std::less<int>> other_types;
+        CHECK_THROWS_AS(other_types.deserialize(buffer.data(), buffer.size()),
+                        std::invalid_argument);
+        CHECK_THROWS_AS(copy.deserialize(buffer.data(), buffer.size() - 1), std::invalid_argument);
+        buffer[0] = 'X';
+        CHECK_THROWS_AS(copy.deserialize(buffer.data(), buffer.size()), std::invalid_argument);
+        CHECK(copy.size() == tree.size());
+    }
+
+    SUBCASE("empty tree") {
+        BTree<int, double, std::less<int>> empty, copy;
+        std::vector<char> buffer(empty.serialized_size());
+        empty.serialize(buffer.data());
+        copy.insert(1, 1);
+        copy.deserialize(buffer.data(), buffer.size());
+        CHECK(copy.size() == 0);
+        CHECK(copy.height() == 0);
+    }
+}
+
+TEST_CASE("statistics policy") {
+    BTree<int, float, std::less<int>, btree_stats::counting> tree;
+    int keys[] = {9, 14, 4, 6, 2, 5, 12, 7, 3, 1, 8, 11, 10, 15, 13};
+    for (int i = 0; i < 15; i++)
+        tree.insert(keys[i], keys[i]);
+
+    btree_stats::snapshot snap = tree.stats();
+    REQUIRE(snap.allocations == 15);
+    REQUIRE(snap.lookups == 14);  // the first insertion does not descend the tree
+    CHECK(snap.height == tree.height());
+    CHECK(snap.comparisons > 0);
+    CHECK(snap.balances == 0);
+
+    SUBCASE("lookups fill the histogram") {
+        tree.reset_stats();
+        tree.find(9);
+        tree.find(3);
+        tree.find(99);
+
+        snap = tree.stats();
+        CHECK(snap.lookups == 3);
+        CHECK(snap.allocations == 0);
+        CHECK(snap.visited[1] == 1);  // the root
+        CHECK(snap.visited[4] == 1);  // 9 -> 4 -> 2 -> 3
+        CHECK(snap.max_visited == 4);
+        CHECK(snap.nodes_visited == 1 + 4 + 3);  // 99 stops at 9 -> 14 -> 15
+    }
+
+    SUBCASE("balance is counted") {
+        tree.balance();
+        tree.balance();
+        snap = tree.stats();
+        CHECK(snap.balances == 2);
+        CHECK(snap.height == 4);
+    }
+
+    SUBCASE("the default policy only reports the height") {
+        BTree<int, float> plain;
+        for (int i = 0; i < 15; i++)
+            plain.insert(keys[i], keys[i]);
+
+        snap = plain.stats();
+        CHECK(snap.height == tree.height());
+        CHECK(snap.lookups == 0);
+        CHECK(snap.comparisons == 0);
+    }
+}
+
+TEST_CASE("memory usage and allocation counts") {
+    BTree<int, int> tree;
+    btree_memory::usage usage = tree.memory_usage();
+    REQUIRE(usage.total() == sizeof(tree));
+    REQUIRE(usage.nodes == 0);
+
+    SUBCASE("one allocation per insertion, none to look up") {
+        alloc_counter::scope inserting;
+        for (int i = 0; i < 100; i++)
+            tree.insert(i, i);
+        std::size_t allocations = inserting.allocations(), bytes = inserting.allocated_bytes();
+        CHECK(allocations == 100);
+
+        usage = tree.memory_usage();
+        std::size_t node = bytes / 100;
+        CHECK(usage.nodes == bytes);
+        CHECK(usage.slack == 100 * (btree_memory::allocated_size(node) - node));
+        CHECK(usage.heap == 0);
+        CHECK(usage.total() == sizeof(tree) + usage.nodes + usage.slack);
+
+        alloc_counter::scope looking_up;
+        int found = 0;
+        for (int i = 0; i < 200; i++) {
+            found += tree.find(i) != tree.cend();
+            found += tree.lower_bound(i) != tree.cend();
+        }
+        for (auto it = tree.cbegin(); it != tree.cend(); ++it)
+            found += it.val() >= 0;
+        allocations = looking_up.allocations();
+        CHECK(allocations == 0);
+        CHECK(found == 300);
+    }
+
+    SUBCASE("balance allocates its scratch space once") {
+        for (int i = 0; i < 1000; i++)
+            tree.insert(i, i);
+
+        alloc_counter::scope balancing;
+        tree.balance();
+        std::size_t allocations = balancing.allocations();
+        long long live = balancing.live_bytes();
+        CHECK(allocations <= 2);
+        CHECK(live == 0);
+        CHECK(tree.height() == 10);
+
+        // Automatic rebalancing adds at most the same scratch space to an insertion.
+        tree.clear();
+        tree.auto_balance(2);
+        std::size_t worst = 0;
+        for (int i = 0; i < 1000; i++) {
+            alloc_counter::scope inserting;
+            tree.insert(i, i);
+            worst = std::max(worst, inserting.allocations());
+        }
+        CHECK(worst <= 3);
+    }
+
+    SUBCASE("heap owned by the keys and the values") {
+        BTree<std::string, std::vector<int>> strings;
+        std::vector<std::string> keys;
+        for (int i = 0; i < 50; i++)
+            keys.push_back("a key long enough for the heap " + std::to_string(i));
+        std::vector<int> value{1, 2, 3};
+
+        alloc_counter::scope inserting;
+        for (const std::string &key : keys)
+            strings.insert(key, value);
+        std::size_t bytes = inserting.allocated_bytes();
+
+        std::size_t owned = 0;
+        for (const std::string &key : keys)
+            owned += key.size() + 1 + value.size() * sizeof(int);
+        usage = strings.memory_usage();
+        CHECK(usage.heap == owned);
+        CHECK(usage.nodes + usage.heap == bytes);
+
+        // Short strings live inside the node.
+        BTree<std::string, int> short_strings;
+        short_strings.insert("a", 1);
+        CHECK(short_strings.memory_usage().heap == 0);
+    }
+}
+
+TEST_CASE("small vector") {
+    small_vector<std::string, 2> v;
+    REQUIRE(v.empty());
+    REQUIRE(v.is_inline());
+
+    v.push_back("a string long enough to live on the heap");
+    v.push_back("b");
+    CHECK(v.is_inline());
+    CHECK(v.size() == 2);
+
+    SUBCASE("growing moves the elements to the heap") {
+        v.push_back(v[0]);
+        CHECK_FALSE(v.is_inline());
+        CHECK(v.size() == 3);
+        CHECK(v.capacity() == 4);
+        CHECK(v[2] == v[0]);
+        CHECK(heap_usage(v) == 4 * sizeof(std::string) + 2 * (v[0].size() + 1));
+    }
+
+    SUBCASE("copy and move") {
+        small_vector<std::string, 2> copy{v};
+        CHECK((copy.size() == 2 and copy[1] == "b"));
+
+        small_vector<std::string, 2> moved{std::move(copy)};
+        CHECK(moved.size() == 2);
+        CHECK(copy.empty());
+
+        moved.push_back("c");
+        const std::string *data = moved.data();
+        copy = std::move(moved);
+        CHECK(copy.data() == data);  // a heap block is stolen
+        CHECK(moved.is_inline());
+
+        copy = v;
+        CHECK(copy.size() == 2);
+    }
+
+    SUBCASE("erase keeps the order") {
+        v.push_back("c");
+        v.erase(v.begin());
+        CHECK(v.size() == 2);
+        CHECK((v.front() == "b" and v.back() == "c"));
+    }
+}
+
+TEST_CASE("multimap with duplicate keys") {
+    BTreeMultimap<int, int, 2> multimap;
+    int keys[] = {9, 14, 4, 9, 6, 9, 4, 12};
+    for (int i = 0; i < 8; i++)
+        multimap.insert(keys[i], i);
+
+    REQUIRE(multimap.size() == 8);
+    REQUIRE(multimap.key_count() == 5);
+
+    SUBCASE("count and equal_range") {
+        CHECK(multimap.count(9) == 3);
+        CHECK(multimap.count(4) == 2);
+        CHECK(multimap.count(5) == 0);
+
+        auto range = multimap.equal_range(9);
+        std::vector<int> values;
+        for (auto it = range.first; it != range.second; ++it) {
+            CHECK(it.key() == 9);
+            values.push_back(*it);
+        }
+        CHECK((values == std::vector<int>{0, 3, 5}));  // in insertion order
+
+        // The end of the range is the first value of the next key.
+        CHECK(range.second.key() == 12);
+        auto it = range.second;
+        CHECK(++it == multimap.equal_range(14).first);
+        CHECK(multimap.equal_range(14).second == multimap.end());
+
+        range = multimap.equal_range(5);
+        CHECK((range.first == multimap.end() and range.second == multimap.end()));
+        CHECK(multimap.values(5) == nullptr);
+        CHECK(multimap.values(4)->size() == 2);
+    }
+
+    SUBCASE("iteration in key order") {
+        std::vector<int> iterated_keys;
+        for (auto it = multimap.begin(); it != multimap.end(); ++it)
+            iterated_keys.push_back(it.key());
+        CHECK((iterated_keys == std::vector<int>{4, 4, 6, 9, 9, 9, 12, 14}));
+    }
+
+    SUBCASE("erase removes every value of a key") {
+        CHECK(multimap.erase(9) == 3);
+        CHECK(multimap.erase(9) == 0);
+        CHECK(multimap.size() == 5);
+        CHECK(multimap.key_count() == 4);
+        CHECK(multimap.count(9) == 0);
+    }
+
+    SUBCASE("values inline in the node cost no allocation") {
+        alloc_counter::scope inserting;
+        multimap.insert(100, 1);
+        multimap.insert(100, 2);
+        std::size_t allocations = inserting.allocations();
+        CHECK(allocations == 1);  // the node
+
+        multimap.insert(100, 3);
+        allocations = inserting.allocations();
+        CHECK(allocations == 2);
+        CHECK(multimap.memory_usage().heap == 2 * 4 * sizeof(int));  // the keys 9 and 100
+    }
+}
+
+TEST_CASE("string keys sharing prefixes") {
+    StringBTree<int> tree;
+    std::map<std::string, int> expected;
+    const std::string base = "https://example.com/catalog/";
+    std::vector<std::string> keys{base + "books/12", base + "books/3", base + "music/7",
+                                  base,            base + "books/120", "https://example.org/",
+                                  "",              base + "books/1",  base + "music/"};
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        tree.insert(keys[i], i);
+        expected[keys[i]] = i;
+    }
+
+    REQUIRE(tree.size() == keys.size());
+
+    SUBCASE("lookups and iteration in std::string order") {
+        for (const std::string &key : keys)
+            CHECK(tree.find(key).val() == expected[key]);
+        CHECK(not tree.contains(base + "books"));
+        CHECK(not tree.contains(base + "books/1200"));
+        CHECK(not tree.contains("https://example.com/"));
+
+        auto it = tree.begin();
+        for (const std::pair<const std::string, int> &pair : expected) {
+            REQUIRE(it != tree.end());
+            CHECK(it.key() == pair.first);
+            ++it;
+        }
+        CHECK(it == tree.end());
+    }
+
+    SUBCASE("shared prefixes are stored once") {
+        std::size_t characters = 0;
+        for (const std::string &key : keys)
+            characters += key.size();
+        CHECK(tree.arena_size() < characters / 2);
+    }
+
+    SUBCASE("insert, operator[] and erase") {
+        tree.insert(base + "music/7", 70);
+        CHECK(tree[base + "music/7"] == 70);
+        tree[base + "music/8"] += 8;
+        CHECK(tree.size() == keys.size() + 1);
+
+        std::pair<std::string, int> erased = tree.erase(base + "books/3");
+        CHECK(erased.first == base + "books/3");
+        CHECK(erased.second == 1);
+        CHECK(tree.garbage() == 1);
+        CHECK_THROWS_AS(tree.erase(base + "books/3"), KeyNotFound);
+
+        const StringBTree<int> &const_tree = tree;
+        CHECK(const_tree[base + "books/12"] == 0);
+        CHECK_THROWS_AS(const_tree[base + "books/3"], KeyNotFound);
+    }
+
+    SUBCASE("compact keeps the live keys only") {
+        for (const std::string &key : {keys[0], keys[4], keys[5]}) {
+            tree.erase(key);
+            expected.erase(key);
+        }
+        for (int i = 0; i < 100; i++)
+            tree.insert(std::to_string(i * 7919) + "/index.html", i);
+        for (int i = 0; i < 100; i++)
+            tree.erase(std::to_string(i * 7919) + "/index.html");
+
+        std::size_t before = tree.arena_size();
+        tree.compact();
+        CHECK(tree.garbage() == 0);
+        CHECK(tree.arena_size() < before / 4);
+        CHECK(tree.memory_usage().heap == tree.arena_size());
+        CHECK(tree.height() == 3);
+
+        auto it = tree.begin();
+        for (const std::pair<const std::string, int> &pair : expected) {
+            CHECK(it.key() == pair.first);
+            CHECK(tree.find(pair.first).val() == pair.second);
+            ++it;
+        }
+        tree.insert(base + "books/2", 20);
+        CHECK(tree.find(base + "books/2").val() == 20);
+    }
+
+    SUBCASE("copies and moves keep their own arena") {
+        StringBTree<int> copy{tree};
+        tree.clear();
+        tree.insert("unrelated", 1);
+        CHECK(copy.size() == keys.size());
+        CHECK(copy.find(base + "music/").val() == 8);
+
+        StringBTree<int> moved{std::move(copy)};
+        CHECK(copy.size() == 0);
+        copy.insert(base, 1);
+        CHECK(copy.find(base).val() == 1);
+        CHECK(moved.find(base).val() == 3);
+        moved.insert(base + "new", 2);
+        CHECK(moved.size() == keys.size() + 1);
+    }
+
+    SUBCASE("smaller than a BTree of std::string") {
+        BTree<std::string, int> plain;
+        StringBTree<int> compressed;
+        for (int i = 0; i < 1000; i++) {
+            std::string key = base + "category-" + std::to_string(i % 10) + "/item-" +
+                              std::to_string(i * 7919 % 1000);
+            plain.insert(key, i);
+            compressed.insert(key, i);
+        }
+        CHECK(compressed.size() == plain.size());
+        CHECK(compressed.memory_usage().heap < plain.memory_usage().heap / 4);
+        CHECK(compressed.memory_usage().total() < plain.memory_usage().total());
+    }
+}
+
+// Clock for the cache tests, moved forward by hand.
+struct manual_clock {
+    using duration = std::chrono::seconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<manual_clock>;
+    static const bool is_steady = true;
+
+    static time_point current;
+    static time_point now() noexcept { return current; }
+};
+manual_clock::time_point manual_clock::current;
+
+TEST_CASE("cache with LRU eviction and expiry") {
+    using Cache = BTreeCache<int, std::string, std::less<int>, manual_clock>;
+    using std::chrono::seconds;
+    manual_clock::current = manual_clock::time_point{};
+
+    Cache cache{3};
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+
+    auto recency = [](const Cache &c) {
+        std::vector<int> keys;
+        c.export_by_recency(std::back_inserter(keys));
+        return keys;
+    };
+
+    SUBCASE("get bumps and the least recently used is evicted") {
+        REQUIRE(cache.get(1) != nullptr);
+        CHECK(*cache.get(1) == "one");
+        CHECK((recency(cache) == std::vector<int>{1, 3, 2}));
+
+        cache.put(4, "four");
+        CHECK(cache.size() == 3);
+        CHECK(cache.evictions() == 1);
+        CHECK(cache.get(2) == nullptr);
+        CHECK((recency(cache) == std::vector<int>{4, 1, 3}));
+
+        cache.put(3, "tre");  // an overwrite bumps without evicting
+        CHECK(*cache.get(3) == "tre");
+        CHECK(cache.evictions() == 1);
+        CHECK((recency(cache) == std::vector<int>{3, 4, 1}));
+    }
+
+    SUBCASE("erase, contains and clear") {
+        CHECK(cache.erase(2));
+        CHECK(not cache.erase(2));
+        CHECK(not cache.contains(2));
+        CHECK(cache.contains(3));
+        CHECK((recency(cache) == std::vector<int>{3, 1}));  // contains does not bump
+
+        cache.clear();
+        CHECK(cache.size() == 0);
+        cache.put(5, "five");
+        CHECK((recency(cache) == std::vector<int>{5}));
+    }
+
+    SUBCASE("entries expire after their time to live") {
+        Cache timed{10, seconds{5}};
+        timed.put(1, "one");
+        manual_clock::current += seconds{2};
+        timed.put(2, "two");
+        timed.put(3, "three");
+
+        manual_clock::current += seconds{4};  // 1 expired
+        CHECK(not timed.contains(1));
+        CHECK(timed.get(1) == nullptr);
+        CHECK(timed.expirations() == 1);
+        CHECK(timed.size() == 2);
+
+        timed.put(2, "deux");  // renews the time to live
+        manual_clock::current += seconds{2};
+        CHECK(timed.get(3) == nullptr);
+        CHECK(*timed.get(2) == "deux");
+        CHECK(timed.expirations() == 2);
+
+        manual_clock::current += seconds{100};
+        CHECK(*cache.get(1) == "one");  // no time to live
+        CHECK(timed.expire() == 1);
+        CHECK(timed.size() == 0);
+    }
+
+    SUBCASE("expiry is amortized over puts") {
+        Cache timed{1000, seconds{1}};
+        for (int i = 0; i < 100; i++)
+            timed.put(i, "old");
+        manual_clock::current += seconds{2};
+        for (int i = 100; i < 150; i++)
+            timed.put(i, "new");
+        CHECK(timed.size() == 50);
+        CHECK(timed.expirations() == 100);
+    }
+
+    SUBCASE("copies keep the recency order") {
+        cache.get(1);
+        Cache copy{cache};
+        CHECK((recency(copy) == std::vector<int>{1, 3, 2}));
+        copy.put(4, "four");
+        CHECK(not copy.contains(2));
+        CHECK(cache.contains(2));
+
+        Cache moved{std::move(copy)};
+        CHECK(copy.size() == 0);
+        CHECK((recency(moved) == std::vector<int>{4, 1, 3}));
+    }
+
+    CHECK_THROWS_AS(Cache{0}, std::invalid_argument);
+}
+
+TEST_CASE("interval queries on an augmented tree") {
+    using Intervals =
+        BTree<int, int, std::less<int>, btree_stats::none, btree_augment::interval<int>>;
+    Intervals tree;  // start -> end
+
+    auto keys = [](Intervals::overlap_iterator it, Intervals::iterator end) {
+        std::vector<int> starts;
+        for (; it != end; ++it)
+            starts.push_back(it.key());
+        return starts;
+    };
+    // The starts of the intervals [start, end) overlapping [lo, hi), by brute force.
+    auto scan = [](const Intervals &t, int lo, int hi) {
+        std::vector<int> starts;
+        for (auto it = t.cbegin(); it != t.cend(); ++it)
+            if (it.key() < hi and it.val() > lo)
+                starts.push_back(it.key());
+        return starts;
+    };
+    auto check_queries = [&](const Intervals &t) {
+        REQUIRE(t.audit() == "");
+        for (int lo = -5; lo < 110; lo += 3) {
+            CHECK(keys(t.overlapping(lo, lo + 7), t.end()) == scan(t, lo, lo + 7));
+            CHECK(keys(t.stabbing(lo), t.end()) == scan(t, lo, lo + 1));
+        }
+    };
+
+    tree.insert(10, 20);
+    tree.insert(5, 8);
+    tree.insert(15, 16);
+    tree.insert(1, 30);
+    tree.insert(25, 27);
+
+    SUBCASE("overlapping is half-open, stabbing is closed") {
+        CHECK((keys(tree.overlapping(8, 15), tree.end()) == std::vector<int>{1, 10}));
+        CHECK((keys(tree.overlapping(16, 26), tree.end()) == std::vector<int>{1, 10, 25}));
+        CHECK((keys(tree.stabbing(15), tree.end()) == std::vector<int>{1, 10, 15}));
+        CHECK((keys(tree.stabbing(8), tree.end()) == std::vector<int>{1}));
+        CHECK(keys(tree.overlapping(30, 40), tree.end()).empty());
+        CHECK((keys(tree.overlapping(12, 12), tree.end()) == std::vector<int>{1, 10}));
+        Intervals empty;
+        CHECK(empty.stabbing(0) == empty.end());
+    }
+
+    SUBCASE("the largest ends follow insert, erase and rebuilds") {
+        std::mt19937 generator{42};
+        for (int i = 0; i < 300; i++) {
+            int start = generator() % 100;
+            tree.insert(start, start + 1 + generator() % 20);
+        }
+        check_queries(tree);
+
+        tree.insert(1, 2);  // overwriting shrinks the longest interval
+        CHECK((keys(tree.stabbing(29), tree.end()) == scan(tree, 29, 30)));
+
+        for (int start = 0; start < 100; start += 3)
+            if (tree.find(start) != tree.end())
+                tree.erase(start);
+        check_queries(tree);
+
+        tree.balance();
+        check_queries(tree);
+
+        tree.auto_balance(2);
+        for (int start = 100; start > 0; start--)
+            tree.insert(start, start + start % 7);
+        check_queries(tree);
+
+        Intervals copy{tree};
+        check_queries(copy);
+    }
+}
+
+// A fresh directory for a DurableBTree, removed with its files on destruction.
+struct temporary_directory {
+    std::string path;
+
+    temporary_directory() {
+        char name[] = "/tmp/btree_wal.XXXXXX";
+        REQUIRE(mkdtemp(name) != nullptr);
+        path = name;
+    }
+    ~temporary_directory() {
+        for (const char *file : {"/log", "/snapshot", "/snapshot.tmp"})
+            std::remove((path + file).c_str());
+        std::remove(path.c_str());
+    }
+
+    // What a crash would leave on the disk: a copy of the files as they are now.
+    void copy_to(const temporary_directory &other) const {
+        for (const char *file : {"/log", "/snapshot"}) {
+            std::ifstream in{path + file, std::ios::binary};
+            if (in)
+                std::ofstream{other.path + file, std::ios::binary} << in.rdbuf();
+        }
+    }
+};
+
+TEST_CASE("durable tree with a write-ahead log") {
+    using Durable = DurableBTree<int, double>;
+    temporary_directory directory;
+    btree_wal::options options;
+    options.group_size = 4;
+
+    auto contents = [](const Durable &db) {
+        std::map<int, double> pairs;
+        for (auto it = db.tree().cbegin(); it != db.tree().cend(); ++it)
+            pairs[it.key()] = it.val();
+        return pairs;
+    };
+
+    std::map<int, double> expected;
+    {
+        Durable db{directory.path, options};
+        CHECK(db.size() == 0);
+        for (int i = 0; i < 10; i++) {
+            db.insert(i, i * 0.5);
+            expected[i] = i * 0.5;
+        }
+        db.erase(3);
+        expected.erase(3);
+        db[4] = 40.0;
+        expected[4] = 40.0;
+        CHECK(double(db[4]) == 40.0);
+        CHECK_THROWS_AS(db.erase(3), KeyNotFound);
+
+        CHECK(db.log_records() == 12);
+        CHECK(db.syncs() == 3);  // groups of 4 records
+
+        SUBCASE("a crash loses the writes not synced yet") {
+            db.insert(100, 1.0);  // below the group size
+            temporary_directory crashed;
+            directory.copy_to(crashed);
+            Durable recovered{crashed.path, options};
+            CHECK(contents(recovered) == expected);
+
+            db.sync();
+            expected[100] = 1.0;
+            temporary_directory synced;
+            directory.copy_to(synced);
+            Durable recovered_after_sync{synced.path, options};
+            CHECK(contents(recovered_after_sync) == expected);
+        }
+    }
+
+    SUBCASE("a delay limit syncs a smaller group on the next write") {
+        options.max_delay = std::chrono::milliseconds{1};
+        Durable db{directory.path, options};
+        db.insert(100, 1.0);
+        CHECK(db.syncs() == 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+        db.insert(101, 2.0);
+        CHECK(db.syncs() == 1);
+
+        expected[100] = 1.0;
+        expected[101] = 2.0;
+        temporary_directory crashed;
+        directory.copy_to(crashed);
+        Durable recovered{crashed.path, options};
+        CHECK(contents(recovered) == expected);
+    }
+
+    SUBCASE("reopening replays the log") {
+        Durable db{directory.path, options};
+        CHECK(contents(db) == expected);
+        CHECK(db.log_records() == 12);
+    }
+
+    SUBCASE("a torn record at the end is dropped") {
+        {
+            std::ofstream log{directory.path + "/log", std::ios::binary | std::ios::app};
+            log << "iXXXX";  // the beginning of a record
+        }
+        {
+            Durable db{directory.path, options};
+            CHECK(contents(db) == expected);
+            db.insert(50, 5.0);  // after the last whole record
+            expected[50] = 5.0;
+        }
+        Durable db{directory.path, options};
+        CHECK(contents(db) == expected);
+    }
+
+    SUBCASE("snapshots empty the log") {
+        {
+            Durable db{directory.path, options};
+            db.snapshot();
+            CHECK(db.log_records() == 0);
+            db.erase(0);
+            expected.erase(0);
+        }
+        Durable db{directory.path, options};
+        CHECK(contents(db) == expected);
+        CHECK(db.log_records() == 1);
+        CHECK(db.tree().height() == 4);  // balanced by deserialize()
+    }
+
+    SUBCASE("automatic snapshots") {
+        options.snapshot_every = 5;
+        {
+            Durable db{directory.path, options};
+            for (int i = 20; i < 32; i++) {
+                db.insert(i, i);
+                expected[i] = i;
+            }
+            CHECK(db.log_records() < 5);
+        }
+        Durable db{directory.path, options};
+        CHECK(contents(db) == expected);
+    }
+
+    SUBCASE("a log of other types is refused") {
+        CHECK_THROWS_AS((DurableBTree<int, int>{directory.path}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("skip list as a drop-in ordered map") {
+    SkipList<int, float> list;
+    int keys[] = {9, 14, 4, 6, 2, 5, 12, 7, 3, 1, 8, 11, 10, 15, 13};
+    for (int i = 0; i < 15; i++)
+        list.insert(keys[i], keys[i]);
+
+    REQUIRE(list.size() == 15);
+
+    int expected = 1;
+    for (auto it = list.begin(); it != list.end(); ++it, ++expected) {
+        CHECK(it.key() == expected);
+        CHECK(*it == doctest::Approx(expected));
+    }
+
+    SUBCASE("find, overwrite and square brackets") {
+        CHECK((list.find(99) == list.end()));
+        list.insert(9, 42);
+        CHECK(list.find(9).val() == doctest::Approx(42));
+        CHECK(list.size() == 15);
+
+        list[100] = 7;
+        CHECK(list.size() == 16);
+        CHECK(list[100] == doctest::Approx(7));
+    }
+
+    SUBCASE("erase") {
+        auto erased = list.erase(9);
+        CHECK(erased.first == 9);
+        CHECK((list.find(9) == list.end()));
+        CHECK(list.size() == 14);
+        CHECK_THROWS_AS(list.erase(9), KeyNotFound);
+
+        list.insert(9, 1);
+        CHECK(list.find(9).val() == doctest::Approx(1));
+    }
+
+    SUBCASE("erased nodes are freed, unless an iterator may reach them") {
+        auto churn = [&list](int first, int n) {
+            for (int key = first; key < first + n; key++) {
+                list.insert(key, 0);
+                list.erase(key);
+            }
+        };
+        churn(100, 100);
+        CHECK(list.unreclaimed() <= 2);
+        {
+            auto held = list.find(5);
+            churn(200, 100);
+            CHECK(list.unreclaimed() >= 100);
+            CHECK(held.key() == 5);
+        }
+        churn(300, 2);
+        CHECK(list.unreclaimed() <= 2);
+    }
+
+    SUBCASE("copy and move") {
+        SkipList<int, float> copy{list};
+        copy.erase(1);
+        CHECK(list.size() - copy.size() == 1);
+
+        SkipList<int, float> moved{std::move(list)};
+        CHECK(moved.size() == 15);
+        CHECK(list.size() == 0);
+        CHECK((list.begin() == list.end()));
+    }
+}
+
+TEST_CASE("skip list under concurrent writers") {
+    SkipList<int, int> list;
+    const int n_threads = 8, per_thread = 2000;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&list, t]() {
+            for (int i = 0; i < per_thread; i++)
+                list.insert(i * n_threads + t, t);
+            // Erase half of our own keys while the others are still inserting.
+            for (int i = 0; i < per_thread; i += 2)
+                list.erase(i * n_threads + t);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    REQUIRE(list.size() == n_threads * per_thread / 2);
+
+    int count = 0, last = -1;
+    for (auto it = list.cbegin(); it != list.cend(); ++it, ++count) {
+        CHECK(last < it.key());
+        CHECK(it.val() == it.key() % n_threads);
+        last = it.key();
+    }
+    CHECK(count == n_threads * per_thread / 2);
+}
+
+TEST_CASE("concurrent readers sharing a tree with a writer") {
+    BTree<int, int, std::less<int>, btree_stats::counting> tree;
+    rw_lock lock;
+    const int n_readers = 4, n_keys = 2000, lookups = 5000;
+
+    for (int i = 0; i < n_keys; i += 2)
+        tree.insert(i, i);
+    tree.reset_stats();
+
+    std::vector<std::thread> threads;
+    // The writer fills in the odd keys, rebalancing from time to time, while the readers look up
+    // the even ones, which must always be there.
+    threads.emplace_back([&]() {
+        for (int i = 1; i < n_keys; i += 2) {
+            rw_lock::write_guard guard{lock};
+            tree.insert(i, i);
+            if (i % 256 == 1)
+                tree.balance();
+        }
+    });
+    std::vector<int> misses(n_readers, 0);
+    for (int r = 0; r < n_readers; r++) {
+        threads.emplace_back([&, r]() {
+            for (int i = 0; i < lookups; i++) {
+                int key = (i * 2 * (r + 1)) % n_keys;
+                rw_lock::read_guard guard{lock};
+                auto it = tree.find(key);
+                if (it == tree.cend() or it.val() != key)
+                    misses[r]++;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    CHECK(std::accumulate(misses.begin(), misses.end(), 0) == 0);
+    CHECK(tree.size() == n_keys);
+
+    // No lookup is lost by the counters, even if they were updated concurrently.
+    auto stats = tree.stats();
+    CHECK(stats.lookups == (unsigned long long)n_readers * lookups + n_keys / 2);
+    CHECK(stats.balances == (n_keys + 255) / 256);
+}
+
+TEST_CASE("sharded tree with concurrent writers") {
+    using Sharded = ShardedBTree<int, int, std::less<int>, 4>;
+    const int n_threads = 4, per_thread = 3000;
+
+    for (Sharded::partitioning p : {Sharded::partitioning::by_hash,
+                                    Sharded::partitioning::by_range}) {
+        Sharded sharded{p};
+
+        // Increasing keys, interleaved among the threads: the worst case for ranges, which must
+        // follow them.
+        std::vector<std::thread> threads;
+        for (int t = 0; t < n_threads; t++)
+            threads.emplace_back([&sharded, t]() {
+                for (int i = 0; i < per_thread; i++)
+                    sharded.insert(i * n_threads + t, t);
+            });
+        for (auto &thread : threads)
+            thread.join();
+
+        REQUIRE(sharded.size() == n_threads * per_thread);
+        std::size_t largest = 0;
+        for (std::size_t i = 0; i < Sharded::shards; i++)
+            largest = std::max(largest, sharded.shard_size(i));
+        CHECK(largest <= 2 * sharded.size() / Sharded::shards + 1024);
+        if (p == Sharded::partitioning::by_range)
+            CHECK(sharded.rebalances() > 0);
+        else
+            CHECK(not sharded.rebalance());
+
+        int value = -1;
+        CHECK(sharded.find(4001, value));
+        CHECK(value == 1);
+        CHECK(not sharded.find(-1, value));
+        CHECK(sharded.erase(4001));
+        CHECK(not sharded.erase(4001));
+        CHECK(not sharded.contains(4001));
+        CHECK(sharded.contains(4002));
+
+        int expected = 0, count = 0;
+        {
+            auto view = sharded.ordered();
+            for (auto it = view.begin(); it != view.end(); ++it, ++expected, ++count) {
+                if (expected == 4001)
+                    expected++;
+                REQUIRE(it.key() == expected);
+                CHECK(it.val() == expected % n_threads);
+            }
+        }
+        CHECK(count == n_threads * per_thread - 1);
+        sharded.insert(-5, 0);  // the view released the locks
+        CHECK(sharded.ordered().begin().key() == -5);
+    }
+
+    CHECK_THROWS_AS((Sharded{Sharded::partitioning::by_range, 1.0}), std::invalid_argument);
+}
+
+TEST_CASE("versioned tree read through snapshots") {
+    using Versioned = VersionedBTree<int, int>;
+    Versioned tree{2};
+    for (int i = 0; i < 100; i++)
+        tree.insert(i, i);
+    CHECK(tree.erase(1000) == 0);
+
+    std::unique_ptr<Versioned::view> before{new Versioned::view{tree.snapshot()}};
+    for (int i = 0; i < 100; i++)
+        tree.insert(i, -i);
+    for (int i = 0; i < 100; i += 2)
+        CHECK(tree.erase(i) > before->epoch());
+    tree.insert(500, 500);
+    CHECK(tree.size() == 51);
+    std::unique_ptr<Versioned::view> after{new Versioned::view{tree.snapshot()}};
+    CHECK(after->epoch() == tree.epoch());
+    CHECK_THROWS_AS(tree.snapshot(), std::length_error);
+
+    // The writes made after a snapshot are invisible to it.
+    int count = 0;
+    for (auto it = before->begin(); it != before->end(); ++it, ++count)
+        CHECK(it.pair() == std::make_pair(count, count));
+    CHECK(count == 100);
+    CHECK((*before)[2] == 2);
+    CHECK_FALSE(before->contains(500));
+    CHECK(before->find(500) == before->end());
+    auto it = before->find(98);
+    CHECK(*it == 98);
+    CHECK((++it).key() == 99);
+    CHECK(++it == before->end());
+
+    auto check_after = [&after]() {
+        int count = 0, last = -1;
+        for (auto it = after->begin(); it != after->end(); ++it, ++count) {
+            CHECK(last < it.key());
+            CHECK((it.key() % 2 == 1 or it.key() == 500));
+            CHECK(it.val() == (it.key() == 500 ? 500 : -it.key()));
+            last = it.key();
+        }
+        CHECK(count == 51);
+        CHECK_THROWS_AS((*after)[2], KeyNotFound);
+        CHECK(after->find(2) == after->end());
+        CHECK(after->find(3).val() == -3);
+    };
+    check_after();
+
+    // A collection keeps the versions the oldest snapshot sees, and all the newer ones.
+    CHECK(tree.versions() == 251);
+    CHECK(tree.collect() == 0);
+    before.reset();
+    CHECK(tree.collect() == 150);
+    CHECK(tree.versions() == 101);
+    check_after();
+    // The erased keys were dropped by a rebuild, but `after` may still be walking them.
+    CHECK(tree.collect() == 0);
+    after.reset();
+    CHECK(tree.collect() == 50);
+    CHECK(tree.versions() == tree.size());
+
+    // Sorted insertions stay fast, as rebuilds keep the tree balanced.
+    for (int i = 1000; i < 50000; i++)
+        tree.insert(i, i);
+    CHECK(tree.snapshot()[49999] == 49999);
+}
+
+TEST_CASE("versioned tree snapshots rolled forward") {
+    using Versioned = VersionedBTree<int, int>;
+    Versioned tree{3};
+    for (int i = 0; i < 10; i++)
+        tree.insert(i, i);
+
+    Versioned::view reader = tree.snapshot();
+    for (int i = 0; i < 10; i++)
+        tree.insert(i, -i);
+    CHECK(tree.collect() == 0);
+
+    // Reassigning releases the old epoch, whose versions can then be freed.
+    reader = tree.snapshot();
+    CHECK(reader.epoch() == tree.epoch());
+    CHECK(reader[3] == -3);
+    CHECK(tree.collect() == 10);
+    CHECK(tree.versions() == 10);
+
+    std::vector<Versioned::view> readers;
+    readers.push_back(tree.snapshot());
+    tree.insert(0, 100);
+    readers.push_back(tree.snapshot());
+    CHECK_THROWS_AS(tree.snapshot(), std::length_error);
+    readers.erase(readers.begin());  // moves the newer snapshot over the older
+    CHECK(readers.front()[0] == 100);
+    reader = tree.snapshot();
+    CHECK(tree.collect() == 1);
+    CHECK(tree.versions() == 10);
+}
+
+TEST_CASE("versioned tree with readers concurrent to a writer") {
+    VersionedBTree<int, int> tree;
+    const int n_keys = 2000, n_readers = 3, rounds = 10;
+    for (int k = 0; k < n_keys; k++)
+        tree.insert(k, 0);
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    // Every round sets the keys to the round number, in key order, and adds and erases as many
+    // other keys, so that collections rebuild the tree under the readers.
+    threads.emplace_back([&]() {
+        for (int round = 1; round <= rounds; round++) {
+            for (int k = 0; k < n_keys; k++)
+                tree.insert(k, round);
+            for (int k = n_keys; k < 2 * n_keys; k++)
+                tree.insert(k, round);
+            for (int k = n_keys; k < 2 * n_keys; k++)
+                tree.erase(k);
+        }
+        done = true;
+    });
+    // A snapshot sees a prefix of the writes: the values go down by at most one along the keys.
+    std::vector<int> errors(n_readers, 0);
+    for (int r = 0; r < n_readers; r++) {
+        threads.emplace_back([&, r]() {
+            do {
+                auto view = tree.snapshot();
+                int count = 0, first = -1, previous = -1;
+                for (auto it = view.begin(); it != view.end() and it.key() < n_keys; ++it) {
+                    if (first < 0)
+                        first = previous = it.val();
+                    if (it.key() != count++ or it.val() > previous or first - it.val() > 1)
+                        errors[r]++;
+                    previous = it.val();
+                }
+                if (count != n_keys or view[count / 2] > first)
+                    errors[r]++;
+            } while (not done);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    CHECK(std::accumulate(errors.begin(), errors.end(), 0) == 0);
+    CHECK(tree.size() == n_keys);
+    tree.collect();
+    tree.collect();
+    CHECK(tree.versions() == n_keys);
+    CHECK(tree.snapshot()[n_keys - 1] == rounds);
+}
+
+// Static storage, so that their addresses, and so their iterators, are constant expressions.
+constexpr auto error_names = make_static_btree<int, const char *>(
+    {{1, "EPERM"}, {2, "ENOENT"}, {3, "ESRCH"}, {4, "EINTR"}, {5, "EIO"}, {9, "EBADF"},
+     {11, "EAGAIN"}, {12, "ENOMEM"}, {13, "EACCES"}, {17, "EEXIST"}});
+constexpr auto unit_factors = make_static_btree<const char *, double, static_btree::c_string_less>(
+    {{"cm", 0.01}, {"km", 1000.0}, {"m", 1.0}, {"mm", 0.001}, {"nm", 1e-9}, {"um", 1e-6}});
+
+static_assert(error_names.size() == 10, "");
+static_assert(error_names.contains(13) and not error_names.contains(6), "");
+static_assert(error_names.find(11).val()[1] == 'A', "");
+static_assert(error_names.begin().key() == 1, "");
+static_assert(error_names.find(10) == error_names.end(), "");
+static_assert(unit_factors["km"] == 1000.0 and unit_factors["mm"] == 0.001, "");
+static_assert(not unit_factors.contains("dm"), "");
+
+TEST_CASE("static tree built at compile time") {
+    std::map<int, const char *> expected{{1, "EPERM"},  {2, "ENOENT"},  {3, "ESRCH"},
+                                         {4, "EINTR"},  {5, "EIO"},     {9, "EBADF"},
+                                         {11, "EAGAIN"}, {12, "ENOMEM"}, {13, "EACCES"},
+                                         {17, "EEXIST"}};
+
+    alloc_counter::scope reading;
+    auto e = expected.begin();
+    for (auto it = error_names.cbegin(); it != error_names.cend(); ++it, ++e) {
+        CHECK(it.key() == e->first);
+        CHECK(std::string{*it} == e->second);
+        CHECK(error_names.find(e->first) == it);
+    }
+    CHECK(e == expected.end());
+    for (int key = -1; key < 20; key++)
+        CHECK(error_names.contains(key) == (expected.count(key) == 1));
+    CHECK_THROWS_AS(error_names[6], KeyNotFound);
+    CHECK(reading.allocations() == 0);
+
+    // Every size, from a single entry to a few full levels and the partial ones in between.
+    std::pair<int, int> entries[] = {{0, 0},   {10, 1},  {20, 2},   {30, 3},   {40, 4},
+                                     {50, 5},  {60, 6},  {70, 7},   {80, 8},   {90, 9},
+                                     {100, 10}, {110, 11}, {120, 12}, {130, 13}, {140, 14},
+                                     {150, 15}};
+    auto check = [](const std::vector<int> &keys, int size) {
+        REQUIRE(keys.size() == (std::size_t)size);
+        for (int i = 0; i < size; i++)
+            CHECK(keys[i] == 10 * i);
+    };
+    std::vector<int> keys;
+    StaticBTree<int, int, 1> one{{{0, 0}}};
+    for (auto it = one.begin(); it != one.end(); ++it)
+        keys.push_back(it.key());
+    check(keys, 1);
+    keys.clear();
+    StaticBTree<int, int, 7> seven{{entries[0], entries[1], entries[2], entries[3], entries[4],
+                                    entries[5], entries[6]}};
+    for (auto it = seven.begin(); it != seven.end(); ++it)
+        keys.push_back(it.key());
+    check(keys, 7);
+    CHECK(seven[60] == 6);
+    keys.clear();
+    StaticBTree<int, int, 16> sixteen{entries};
+    for (auto it = sixteen.begin(); it != sixteen.end(); ++it)
+        keys.push_back(it.key());
+    check(keys, 16);
+    for (int i = 0; i < 16; i++)
+        CHECK(*sixteen.find(10 * i) == i);
+    CHECK(sixteen.find(15) == sixteen.end());
+
+    // At run time, unsorted entries throw instead of failing to compile.
+    std::swap(entries[3], entries[4]);
+    CHECK_THROWS_AS((StaticBTree<int, int, 16>{entries}), std::invalid_argument);
+}
+
+TEST_CASE("radix tree for integer keys") {
+    RadixTree<int, int> tree;
+    std::map<int, int> reference;
+
+    // Negative keys, keys sharing long prefixes and enough neighbours to grow dense nodes.
+    for (int i = -300; i < 300; i += 3) {
+        tree.insert(i, -i);
+        reference[i] = -i;
+    }
+    int far_keys[] = {1 << 30, -(1 << 30), 2147483647, -2147483647 - 1, 65536, 65537};
+    for (int key : far_keys) {
+        tree.insert(key, key);
+        reference[key] = key;
+    }
+
+    REQUIRE(tree.size() == reference.size());
+
+    auto check_order = [&tree, &reference]() {
+        auto ref = reference.begin();
+        for (auto it = tree.cbegin(); it != tree.cend(); ++it, ++ref) {
+            REQUIRE((ref != reference.end()));
+            CHECK(it.key() == ref->first);
+            CHECK(it.val() == ref->second);
+        }
+        CHECK((ref == reference.end()));
+    };
+    check_order();
+
+    SUBCASE("find and lower_bound") {
+        CHECK(tree.find(-300).val() == 300);
+        CHECK((tree.find(-299) == tree.end()));
+        CHECK(tree.find(65537).val() == 65537);
+
+        for (int key = -310; key < 310; key++) {
+            auto it = tree.lower_bound(key);
+            auto ref = reference.lower_bound(key);
+            REQUIRE(it.key() == ref->first);
+        }
+        CHECK(tree.lower_bound(2147483647).key() == 2147483647);
+        CHECK((tree.lower_bound(1 << 30 | 1).key() == 2147483647));
+    }
+
+    SUBCASE("erase shrinks the tree") {
+        for (int i = -300; i < 300; i += 6) {
+            CHECK(tree.erase(i).second == -i);
+            reference.erase(i);
+        }
+        CHECK_THROWS_AS(tree.erase(-300), KeyNotFound);
+        REQUIRE(tree.size() == reference.size());
+        check_order();
+
+        for (int key : far_keys)
+            tree.erase(key);
+        while (tree.size())
+            tree.erase(tree.begin().key());
+        CHECK((tree.begin() == tree.end()));
+    }
+
+    SUBCASE("square brackets, copy and move") {
+        tree[7] = 49;
+        CHECK(tree.find(7).val() == 49);
+        CHECK(tree[6] == -6);
+
+        RadixTree<int, int> copy{tree};
+        copy.erase(7);
+        CHECK(tree.size() - copy.size() == 1);
+
+        RadixTree<int, int> moved{std::move(tree)};
+        CHECK(moved.size() == copy.size() + 1);
+        CHECK(tree.size() == 0);
+    }
+}
+
 TEST_CASE("print iterator") {
     BTree<int, float, std::less<int>> tree;
     float value = 3.14;
@@ -0,0 +1,490 @@
+#ifndef __VERSIONED_BTREE_H__
+#define __VERSIONED_BTREE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>  // std::less
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "btree.h"  // KeyNotFound
+
+// Multi-version search tree: every key holds a chain of versions of its value, newest first, each
+// stamped with the epoch of the write that made it. A write advances the global epoch; a reader
+// takes a snapshot(), which pins the current epoch and reads the tree as it was then, whatever
+// the writers do afterwards, without locking and without copying anything.
+//
+// The versions that no pinned epoch can see any more are reclaimed by collect(), which runs by
+// itself every max(1024, nodes) writes: of every chain it keeps the versions newer than the oldest
+// snapshot and the one visible to it. Keys erased before the oldest snapshot are dropped by
+// rebuilding the tree once they are a quarter of it.
+//
+// The nodes are never rotated, so that a reader walking down the tree is never misled: the tree is
+// kept balanced scapegoat-style, by rebuilding the subtree above an insertion deeper than
+// log_{3/2}(nodes) into fresh nodes and swapping it in with a single store. The nodes replaced
+// are freed once the snapshots older than the swap are released, like those dropped by collect().
+//
+// Thread safety: any number of threads can read through snapshots while others write; the writes
+// are serialized by a mutex. At most `max_readers` snapshots can exist at once, and none when the
+// tree is destroyed. erase() needs V to be default constructible.
+template <typename K, typename V, typename cmp = std::less<K>>
+class VersionedBTree {
+   public:
+    using key_type = K;
+    using value_type = V;
+    using epoch_type = std::uint64_t;
+
+   private:
+    struct version {
+        const V value;
+        const epoch_type epoch;
+        const bool erased;
+        std::atomic<version *> next;
+
+        version(const V &v, epoch_type e, bool erased, version *next)
+            : value{v}, epoch{e}, erased{erased}, next{next} {}
+    };
+
+    // Raw pointers rather than unique_ptr: the links are read concurrently, and a node replaced by
+    // a rebuild must outlive the snapshots that may still be walking it.
+    struct Node {
+        const K key;
+        std::atomic<version *> head;
+        std::atomic<Node *> left{nullptr}, right{nullptr};
+
+        Node(const K &key, version *head) : key{key}, head{head} {}
+    };
+
+    // A reader slot holds the epoch pinned by a snapshot, or one of these two markers.
+    static constexpr epoch_type _free = std::numeric_limits<epoch_type>::max();
+    static constexpr epoch_type _claimed = _free - 1;
+
+    // Padded to a cache line, so that readers pinning and releasing do not share one; padded
+    // rather than aligned, as C++11 operator new ignores extended alignments.
+    struct reader_slot {
+        std::atomic<epoch_type> epoch{_free};
+        char padding[64 - sizeof(std::atomic<epoch_type>)];
+    };
+
+    // Nodes to free once no snapshot older than `epoch` is left, with the chain of versions of
+    // the dropped ones.
+    struct retired {
+        epoch_type epoch;
+        Node *node;
+        version *chain;
+    };
+
+    std::atomic<Node *> _root{nullptr};
+    std::atomic<epoch_type> _epoch{0};
+    const std::size_t _max_readers;
+    std::unique_ptr<reader_slot[]> _readers;
+    const cmp comparator{};
+
+    // Owned by the writers.
+    std::mutex _write_lock;
+    std::size_t _nodes{0}, _writes{0};
+    std::vector<Node *> _path;
+    std::vector<retired> _retired;
+    std::atomic<std::size_t> _size{0}, _versions{0};
+
+    static constexpr std::size_t _collect_every = 1024;
+
+    // The newest version of `node` not newer than `at`, if any.
+    static const version *_visible(const Node *node, epoch_type at) noexcept {
+        const version *v = node->head.load(std::memory_order_acquire);
+        while (v and v->epoch > at)
+            v = v->next.load(std::memory_order_acquire);
+        return v;
+    }
+
+    void _free_chain(version *v) noexcept {
+        while (v) {
+            version *next = v->next.load(std::memory_order_relaxed);
+            delete v;
+            _versions.fetch_sub(1, std::memory_order_relaxed);
+            v = next;
+        }
+    }
+
+    static std::size_t _count(const Node *node) noexcept {
+        return node ? 1 + _count(node->left.load(std::memory_order_relaxed)) +
+                          _count(node->right.load(std::memory_order_relaxed))
+                    : 0;
+    }
+
+    static void _flatten(Node *node, std::vector<Node *> &nodes) {
+        while (node) {
+            _flatten(node->left.load(std::memory_order_relaxed), nodes);
+            nodes.push_back(node);
+            node = node->right.load(std::memory_order_relaxed);
+        }
+    }
+
+    // A perfectly balanced copy of the sorted `nodes`, sharing their chains of versions.
+    static Node *_build(Node *const *nodes, std::size_t n) {
+        if (n == 0)
+            return nullptr;
+        const std::size_t middle = n / 2;
+        Node *node =
+            new Node{nodes[middle]->key, nodes[middle]->head.load(std::memory_order_relaxed)};
+        node->left.store(_build(nodes, middle), std::memory_order_relaxed);
+        node->right.store(_build(nodes + middle + 1, n - middle - 1), std::memory_order_relaxed);
+        return node;
+    }
+
+    // Replace the subtree hanging from `link` with a balanced copy, retiring its nodes until the
+    // epoch `swapped` is published.
+    void _rebuild(std::atomic<Node *> &link, std::size_t size, epoch_type swapped) {
+        std::vector<Node *> nodes;
+        nodes.reserve(size);
+        _flatten(link.load(std::memory_order_relaxed), nodes);
+        link.store(_build(nodes.data(), nodes.size()), std::memory_order_release);
+        for (Node *node : nodes)
+            _retired.push_back({swapped, node, nullptr});
+    }
+
+    // After inserting `leaf` below the nodes in `_path`: rebuild the subtree of the lowest
+    // ancestor whose child on the path holds more than 2/3 of its nodes, which exists as the leaf
+    // is deeper than log_{3/2}(nodes).
+    void _rebalance(Node *leaf, epoch_type swapped) {
+        const Node *child = leaf;
+        std::size_t child_size = 1;
+        for (std::size_t i = _path.size(); i-- > 0;) {
+            Node *parent = _path[i];
+            Node *left = parent->left.load(std::memory_order_relaxed);
+            const std::size_t size =
+                1 + child_size +
+                _count(child == left ? parent->right.load(std::memory_order_relaxed) : left);
+            if (3 * child_size > 2 * size) {
+                if (i == 0)
+                    _rebuild(_root, size, swapped);
+                else if (_path[i - 1]->left.load(std::memory_order_relaxed) == parent)
+                    _rebuild(_path[i - 1]->left, size, swapped);
+                else
+                    _rebuild(_path[i - 1]->right, size, swapped);
+                return;
+            }
+            child = parent;
+            child_size = size;
+        }
+    }
+
+    // Prepend a version of `key` stamped with the next epoch, erasing it if `value` is null.
+    // Returns the epoch of the write, or 0 if there was nothing to erase.
+    epoch_type _write(const K &key, const V *value) {
+        std::lock_guard<std::mutex> guard{_write_lock};
+        const epoch_type next = _epoch.load(std::memory_order_relaxed) + 1;
+
+        _path.clear();
+        std::atomic<Node *> *link = &_root;
+        Node *node;
+        while ((node = link->load(std::memory_order_relaxed))) {
+            if (comparator(key, node->key))
+                link = &node->left;
+            else if (comparator(node->key, key))
+                link = &node->right;
+            else
+                break;
+            _path.push_back(node);
+        }
+
+        if (node) {
+            version *current = node->head.load(std::memory_order_relaxed);
+            if (not value and current->erased)
+                return 0;
+            if (current->erased)
+                _size++;
+            else if (not value)
+                _size--;
+            node->head.store(new version{value ? *value : V{}, next, not value, current},
+                             std::memory_order_release);
+        } else {
+            if (not value)
+                return 0;
+            Node *leaf = new Node{key, new version{*value, next, false, nullptr}};
+            link->store(leaf, std::memory_order_release);
+            _nodes++;
+            _size++;
+            if (_path.size() > std::log(double(_nodes)) / std::log(1.5))
+                _rebalance(leaf, next);
+        }
+        _versions++;
+
+        _epoch.store(next);
+        if (++_writes >= std::max(_nodes, std::size_t{_collect_every}))
+            _collect();
+        return next;
+    }
+
+    std::size_t _collect();
+
+   public:
+    explicit VersionedBTree(std::size_t max_readers = 64)
+        : _max_readers{max_readers}, _readers{new reader_slot[max_readers]} {}
+
+    VersionedBTree(const VersionedBTree &) = delete;
+    VersionedBTree &operator=(const VersionedBTree &) = delete;
+
+    ~VersionedBTree() {
+        for (const retired &r : _retired) {
+            delete r.node;
+            _free_chain(r.chain);
+        }
+        std::vector<Node *> nodes;
+        _flatten(_root.load(std::memory_order_relaxed), nodes);
+        for (Node *node : nodes) {
+            _free_chain(node->head.load(std::memory_order_relaxed));
+            delete node;
+        }
+    }
+
+    // Both return the epoch of the write; erase() returns 0 if `key` is missing.
+    epoch_type insert(const K &key, const V &value) { return _write(key, &value); }
+    epoch_type erase(const K &key) { return _write(key, nullptr); }
+
+    // Reclaim the versions and the nodes no snapshot can reach any more, returning the number of
+    // versions freed.
+    std::size_t collect() {
+        std::lock_guard<std::mutex> guard{_write_lock};
+        return _collect();
+    }
+
+    // The current epoch, advanced by every write and collection, the keys present at that epoch
+    // and the versions kept for all of them; readable without locks, exact only while no thread
+    // writes.
+    epoch_type epoch() const noexcept { return _epoch.load(); }
+    std::size_t size() const noexcept { return _size.load(std::memory_order_relaxed); }
+    std::size_t versions() const noexcept { return _versions.load(std::memory_order_relaxed); }
+
+    class view;
+    // The tree as of the current epoch, until the view is destroyed. Throws std::length_error if
+    // `max_readers` views already exist.
+    view snapshot() const { return view{*this}; }
+};
+
+template <typename K, typename V, typename cmp>
+std::size_t VersionedBTree<K, V, cmp>::_collect() {
+    const std::size_t before = _versions.load(std::memory_order_relaxed);
+    _writes = 0;
+
+    // A new epoch first: a reader pinning an older one after the scan below sees it, and pins
+    // again.
+    const epoch_type now = _epoch.load(std::memory_order_relaxed) + 1;
+    _epoch.store(now);
+    epoch_type oldest = now;
+    for (std::size_t i = 0; i < _max_readers; i++) {
+        epoch_type pinned = _readers[i].epoch.load();
+        if (pinned < _claimed)
+            oldest = std::min(oldest, pinned);
+    }
+
+    auto reclaimable = std::partition(_retired.begin(), _retired.end(),
+                                      [oldest](const retired &r) { return r.epoch > oldest; });
+    for (auto it = reclaimable; it != _retired.end(); ++it) {
+        delete it->node;
+        _free_chain(it->chain);
+    }
+    _retired.erase(reclaimable, _retired.end());
+
+    // Every snapshot sees `keep` or a newer version, and stops there: the older ones can go now.
+    std::vector<Node *> nodes;
+    nodes.reserve(_nodes);
+    _flatten(_root.load(std::memory_order_relaxed), nodes);
+    std::size_t dropped = 0;
+    for (Node *node : nodes) {
+        version *head = node->head.load(std::memory_order_relaxed);
+        version *keep = head;
+        while (keep and keep->epoch > oldest)
+            keep = keep->next.load(std::memory_order_relaxed);
+        if (not keep)
+            continue;
+        _free_chain(keep->next.exchange(nullptr, std::memory_order_relaxed));
+        if (keep == head and keep->erased)
+            dropped++;
+    }
+
+    // The keys erased for every snapshot still route the lookups: they leave with a rebuild.
+    if (dropped > 0 and 4 * dropped >= _nodes) {
+        std::vector<Node *> present;
+        present.reserve(_nodes - dropped);
+        for (Node *node : nodes) {
+            version *head = node->head.load(std::memory_order_relaxed);
+            if (head->epoch <= oldest and head->erased) {
+                _retired.push_back({now + 1, node, head});
+            } else {
+                present.push_back(node);
+                _retired.push_back({now + 1, node, nullptr});
+            }
+        }
+        _root.store(_build(present.data(), present.size()), std::memory_order_release);
+        _nodes = present.size();
+        _epoch.store(now + 1);
+    }
+    return before - _versions.load(std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename cmp>
+class VersionedBTree<K, V, cmp>::view {
+    const VersionedBTree *_owner;
+    reader_slot *_slot{nullptr};
+    epoch_type _epoch;
+    const Node *_root;
+
+    // The version of `key` visible at the epoch, if present.
+    const version *_get(const K &key) const noexcept {
+        const Node *node = _root;
+        while (node) {
+            if (_owner->comparator(key, node->key))
+                node = node->left.load(std::memory_order_acquire);
+            else if (_owner->comparator(node->key, key))
+                node = node->right.load(std::memory_order_acquire);
+            else {
+                const version *v = _visible(node, _epoch);
+                return v and not v->erased ? v : nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+   public:
+    explicit view(const VersionedBTree &owner) : _owner{&owner} {
+        for (std::size_t i = 0; i < owner._max_readers and not _slot; i++) {
+            epoch_type expected = _free;
+            if (owner._readers[i].epoch.compare_exchange_strong(expected, _claimed))
+                _slot = &owner._readers[i];
+        }
+        if (not _slot)
+            throw std::length_error{"VersionedBTree: too many snapshots at once"};
+
+        // Pin the current epoch, again if it moves meanwhile: see _collect().
+        do {
+            _epoch = owner._epoch.load();
+            _slot->epoch.store(_epoch);
+        } while (owner._epoch.load() != _epoch);
+        _root = owner._root.load(std::memory_order_acquire);
+    }
+    ~view() {
+        if (_slot)
+            _slot->epoch.store(_free, std::memory_order_release);
+    }
+
+    view(view &&other) noexcept
+        : _owner{other._owner}, _slot{other._slot}, _epoch{other._epoch}, _root{other._root} {
+        other._slot = nullptr;
+    }
+    // Releases the snapshot held, e.g. to roll a long-lived reader forward with
+    // `v = tree.snapshot()`.
+    view &operator=(view &&other) noexcept {
+        if (this != &other) {
+            if (_slot)
+                _slot->epoch.store(_free, std::memory_order_release);
+            _owner = other._owner;
+            _slot = other._slot;
+            _epoch = other._epoch;
+            _root = other._root;
+            other._slot = nullptr;
+        }
+        return *this;
+    }
+    view(const view &) = delete;
+    view &operator=(const view &) = delete;
+
+    epoch_type epoch() const noexcept { return _epoch; }
+
+    // In-order traversal with a stack, as the nodes have no parent pointers.
+    class iterator {
+        friend class view;
+
+        // The current node on top of the ancestors still to visit after it.
+        std::vector<const Node *> _stack;
+        epoch_type _epoch;
+        const version *_current{nullptr};
+
+        explicit iterator(epoch_type epoch) : _epoch{epoch} {}
+
+        void _descend(const Node *node) {
+            for (; node; node = node->left.load(std::memory_order_acquire))
+                _stack.push_back(node);
+        }
+        void _step() {
+            const Node *node = _stack.back();
+            _stack.pop_back();
+            _descend(node->right.load(std::memory_order_acquire));
+        }
+        // Skip the keys missing at the epoch.
+        void _settle() {
+            for (; not _stack.empty(); _step()) {
+                _current = _visible(_stack.back(), _epoch);
+                if (_current and not _current->erased)
+                    return;
+            }
+        }
+
+       public:
+        const K &key() const noexcept { return _stack.back()->key; }
+        const V &val() const noexcept { return _current->value; }
+        const std::pair<K, V> pair() const { return {key(), val()}; }
+        const V &operator*() const noexcept { return val(); }
+
+        iterator &operator++() {
+            _step();
+            _settle();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const noexcept {
+            if (_stack.empty() or other._stack.empty())
+                return _stack.empty() and other._stack.empty();
+            return _stack.back() == other._stack.back();
+        }
+        bool operator!=(const iterator &other) const noexcept { return not(*this == other); }
+    };
+
+    iterator begin() const {
+        iterator it{_epoch};
+        it._descend(_root);
+        it._settle();
+        return it;
+    }
+    iterator end() const { return iterator{_epoch}; }
+
+    iterator find(const K &key) const {
+        iterator it{_epoch};
+        const Node *node = _root;
+        while (node) {
+            if (_owner->comparator(key, node->key)) {
+                it._stack.push_back(node);
+                node = node->left.load(std::memory_order_acquire);
+            } else if (_owner->comparator(node->key, key)) {
+                node = node->right.load(std::memory_order_acquire);
+            } else {
+                it._stack.push_back(node);
+                it._current = _visible(node, _epoch);
+                if (it._current and not it._current->erased)
+                    return it;
+                break;
+            }
+        }
+        return end();
+    }
+
+    bool contains(const K &key) const noexcept { return _get(key) != nullptr; }
+
+    // Throws KeyNotFound if `key` is missing at the epoch.
+    const V &operator[](const K &key) const {
+        const version *v = _get(key);
+        if (not v)
+            throw KeyNotFound{};
+        return v->value;
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+
+# Moving a built tree to another process: pickling (a binary copy of the sorted keys and values,
+# rebuilt in linear time on the other side) against sending the pairs as lists and inserting them
+# one by one, or as arrays with insert_many.
+
+import pickle
+import time
+from multiprocessing import Pool
+
+import numpy as np
+
+import bestbst
+
+
+def timed(what, function, *args):
+    start = time.perf_counter()
+    result = function(*args)
+    print("{:40s} {:8.3f} s".format(what, time.perf_counter() - start))
+    return result
+
+
+def rebuild_by_insert(pairs):
+    tree = bestbst.BTree()
+    for key, value in zip(*pairs):
+        tree.insert(key, value)
+    tree.balance()
+    return tree
+
+
+def rebuild_by_batch(arrays):
+    tree = bestbst.BTree()
+    tree.insert_many(*arrays)
+    tree.balance()
+    return tree
+
+
+def size_of(tree):
+    return len(tree)
+
+
+def size_after_insert(pairs):
+    return len(rebuild_by_insert(pairs))
+
+
+if __name__ == "__main__":
+
+    _tree_size = 1000000
+    _seed = 314
+
+    np.random.seed(_seed)
+    keys = np.random.permutation(_tree_size).astype(np.int32)
+
+    print("Building a tree of", _tree_size, "keys...")
+    tree = bestbst.BTree()
+    tree.insert_many(keys, keys)
+    tree.balance()
+
+    print("\nIn process:")
+    state = timed("pickle.dumps", pickle.dumps, tree, pickle.HIGHEST_PROTOCOL)
+    print("{:40s} {:8.1f} MB".format("pickle size", len(state) / 2**20))
+    copy = timed("pickle.loads", pickle.loads, state)
+    assert len(copy) == len(tree) and copy.is_balanced()
+
+    arrays = timed("to_numpy", tree.to_numpy)
+    timed("assign_sorted", copy.assign_sorted, *arrays)
+
+    pairs = timed("keys and values as lists", lambda: (list(tree.keys()), list(tree.values())))
+    timed("rebuild by insert", rebuild_by_insert, pairs)
+    timed("rebuild by insert_many", rebuild_by_batch, arrays)
+
+    print("\nTo a worker process:")
+    with Pool(1) as pool:
+        pool.apply(size_of, (bestbst.BTree(),))  # start the worker first
+        timed("pickled tree", pool.apply, size_of, (tree,))
+        timed("lists, rebuilt by insert", pool.apply, size_after_insert, (pairs,))
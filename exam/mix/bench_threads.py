@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+
+# Lookups from a pool of threads on one shared tree: the lookups release the GIL while they run in
+# C++, so the batched ones should scale almost linearly with the number of threads, up to the
+# number of cores. Single find() calls spend most of their time in the binding, under the GIL, and
+# scale much less.
+
+import os
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+import bestbst
+
+
+def run(tree, n_threads, work):
+    with ThreadPoolExecutor(max_workers=n_threads) as pool:
+        start = time.perf_counter()
+        list(pool.map(work, [tree] * n_threads))
+        return time.perf_counter() - start
+
+
+def batched(tree):
+    for _ in range(_rounds):
+        tree.find_many(test_set)
+
+
+def one_by_one(tree):
+    for key in test_set[:_n_single].tolist():
+        tree.find(key)
+
+
+if __name__ == "__main__":
+
+    _tree_size = 1000000
+    _n_tests = 100000
+    _n_single = 20000
+    _rounds = 10
+    _seed = 314
+
+    np.random.seed(_seed)
+    test_set = (np.random.rand(_n_tests) * _tree_size).astype(np.int32)
+
+    print("Filling a balanced tree of", _tree_size, "keys...")
+    tree = bestbst.BTree()
+    keys = np.arange(_tree_size, dtype=np.int32)
+    np.random.shuffle(keys)
+    tree.insert_many(keys, keys)
+    tree.balance()
+
+    # Every thread does the same amount of work, so with perfect scaling the time stays constant.
+    print("threads   find_many [s]  speedup   find [s]  speedup")
+    base = None
+    for n_threads in sorted({1, 2, 4, 8, os.cpu_count() or 1}):
+        t_batched = run(tree, n_threads, batched)
+        t_single = run(tree, n_threads, one_by_one)
+        if base is None:
+            base = (t_batched, t_single)
+        print("{:7d} {:14.3f} {:8.2f} {:10.3f} {:8.2f}".format(
+            n_threads, t_batched, n_threads * base[0] / t_batched,
+            t_single, n_threads * base[1] / t_single))
@@ -1,44 +1,196 @@
 #!/usr/bin/env python3
 
+# Benchmark suite for the bestbst binding, with the same methodology and JSON output as the
+# native one (exam/c++/bench/btree_suite.cc): every benchmark times a stream of operations in
+# batches, after some untimed warmup repetitions, and reports the percentiles of the nanoseconds
+# per operation over all the batches.
+#
+# Operations: insert, find-hit, find-miss, erase, iterate and balance, one call per key, plus the
+# NumPy batch versions (insert-many, find-many). Distributions: sequential (ascending keys),
+# uniform and Zipf-skewed lookups over keys inserted in random order.
+#
+# usage: benchmarks.py [--sizes 1000,10000,100000] [--warmup 1] [--repetitions 5]
+#                      [--batch 1000] [--max-degenerate 20000] [--json results.json]
+
+import argparse
+import datetime
+import json
 import time
+
 import numpy as np
 
 import bestbst
 
-def execute():
-    print("\nStarting on a tree of height", tree.height(), "...", end='')
 
-    start = time.process_time()
-    for i in test_set:
-        tree.find(i)
-    stop = time.process_time()
+class Suite:
 
-    print(stop - start, "s")
+    def __init__(self, warmup, repetitions, batch):
+        self.warmup = warmup
+        self.repetitions = repetitions
+        self.batch = batch
+        self.records = []
 
+    def run(self, structure, operation, distribution, size, n, setup, op):
+        """Run setup() before every repetition, then time op(first, last) on batches of the
+        operations in [0, n); op performs all the operations of the batch."""
+        batch = max(1, min(self.batch, n))
+        samples = []
+        for rep in range(self.warmup + self.repetitions):
+            setup()
+            for first in range(0, n, batch):
+                last = min(first + batch, n)
+                start = time.perf_counter_ns()
+                op(first, last)
+                elapsed = time.perf_counter_ns() - start
+                if rep >= self.warmup:
+                    samples.append(elapsed / (last - first))
 
-if __name__ == "__main__":
+        # Nearest-rank percentiles, as in the native suite.
+        samples = np.sort(samples)
+        summary = {"samples": len(samples), "min": samples[0], "max": samples[-1],
+                   "mean": samples.mean(), "stddev": samples.std()}
+        for p in [50, 90, 99]:
+            summary["p{}".format(p)] = samples[max(0, int(np.ceil(p / 100 * len(samples))) - 1)]
+
+        self.records.append({"name": "/".join([structure, operation, distribution, str(size)]),
+                             "structure": structure, "operation": operation,
+                             "distribution": distribution, "size": size,
+                             "ns_per_op": {k: float(v) for k, v in summary.items()}})
+
+    def write_table(self):
+        print("{:16s}{:12s}{:12s}{:>10s}{:>10s}{:>10s}{:>10s}{:>10s}  [ns/op]".format(
+            "structure", "operation", "distribution", "size", "p50", "p90", "p99", "min"))
+        for r in self.records:
+            s = r["ns_per_op"]
+            print("{:16s}{:12s}{:12s}{:10d}{:10.1f}{:10.1f}{:10.1f}{:10.1f}".format(
+                r["structure"], r["operation"], r["distribution"], r["size"],
+                s["p50"], s["p90"], s["p99"], s["min"]))
+
+    def write_json(self, path):
+        context = {"date": datetime.datetime.now().isoformat(timespec="seconds"),
+                   "language": "python", "warmup": self.warmup,
+                   "repetitions": self.repetitions, "batch": self.batch,
+                   "stats": bestbst.BTree().stats()["enabled"]}
+        with open(path, "w") as f:
+            json.dump({"context": context, "benchmarks": self.records}, f, indent=2)
+
+
+# The keys stored in the trees are the even numbers 0, 2, ..., 2 (size - 1), so that odd numbers
+# are guaranteed misses.
+
+def zipf(size, n, exponent=0.99):
+    """Zipf-distributed ranks mapped to keys through a random permutation."""
+    weights = 1.0 / np.arange(1, size + 1) ** exponent
+    cdf = np.cumsum(weights)
+    ranks = np.searchsorted(cdf, np.random.rand(n) * cdf[-1])
+    by_rank = np.random.permutation(size) * 2
+    return by_rank[np.minimum(ranks, size - 1)]
+
+
+def workload(distribution, size):
+    keys = np.arange(size, dtype=np.int32) * 2
+    if distribution == "sequential":
+        return keys, keys, keys
+    insert_order = np.random.permutation(keys)
+    erase_order = np.random.permutation(keys)
+    if distribution == "uniform":
+        queries = np.random.randint(0, size, size).astype(np.int32) * 2
+    else:
+        queries = zipf(size, size).astype(np.int32)
+    return insert_order, erase_order, queries
+
+
+def run_structure(suite, structure, make_tree, distribution, orders):
+    insert_order, erase_order, queries = orders
+    size = len(insert_order)
+    # Plain lists, so that the per-call benchmarks do not measure NumPy scalar conversions.
+    insert_list, erase_list = insert_order.tolist(), erase_order.tolist()
+    hits, misses = queries.tolist(), (queries + 1).tolist()
+    state = {}
 
-    _n_tests = 10000
-    _tree_size = 100000
-    _seed = 314
+    def fresh():
+        state["tree"] = make_tree()
 
-    np.random.seed(_seed)
-    test_set = np.random.rand(_n_tests) * _tree_size # To get keys that actually exist
-    test_set = [int(x) for x in test_set]
+    def filled():
+        fresh()
+        state["tree"].insert_many(insert_order, insert_order)
 
-    print("====================================================")
-    print("== Benchmarking Binary Search Tree implementation ==")
-    print("== Tree size:", _tree_size, "      Number of tries:", _n_tests, "==")
-    print("====================================================")
+    def insert(first, last):
+        tree = state["tree"]
+        for key in insert_list[first:last]:
+            tree.insert(key, key)
 
-    print("Filling the tree...")
+    def find(keys):
+        def op(first, last):
+            tree = state["tree"]
+            for key in keys[first:last]:
+                tree.find(key)
+        return op
 
+    def erase(first, last):
+        tree = state["tree"]
+        for key in erase_list[first:last]:
+            tree.erase(key)
+
+    def iterate(first, last):
+        iterator = state["iterator"]
+        for _ in range(last - first):
+            next(iterator)
+
+    def start_iteration():
+        state["iterator"] = iter(state["tree"])
+
+    suite.run(structure, "insert", distribution, size, size, fresh, insert)
+    suite.run(structure, "insert-many", distribution, size, size, fresh,
+              lambda first, last: state["tree"].insert_many(insert_order[first:last],
+                                                            insert_order[first:last]))
+
+    filled()
+    suite.run(structure, "find-hit", distribution, size, size, lambda: None, find(hits))
+    suite.run(structure, "find-miss", distribution, size, size, lambda: None, find(misses))
+    suite.run(structure, "find-many", distribution, size, size, lambda: None,
+              lambda first, last: state["tree"].find_many(queries[first:last]))
+
+    if hasattr(state["tree"], "__iter__"):
+        suite.run(structure, "iterate", distribution, size, size, start_iteration, iterate)
+
+    suite.run(structure, "erase", distribution, size, size, filled, erase)
+
+    if hasattr(state["tree"], "balance"):
+        suite.run(structure, "balance", distribution, size, 1, filled,
+                  lambda first, last: state["tree"].balance())
+
+
+def auto_balanced():
     tree = bestbst.BTree()
-    [tree.insert(x, 0) for x in range(_tree_size)]
+    tree.auto_balance = 2
+    return tree
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Benchmark suite for bestbst.")
+    parser.add_argument("--sizes", default="1000,10000,100000")
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--repetitions", type=int, default=5)
+    parser.add_argument("--batch", type=int, default=1000)
+    parser.add_argument("--max-degenerate", type=int, default=20000,
+                        help="largest size for sequential insertions into an unbalanced tree")
+    parser.add_argument("--json", help="write the results to this file")
+    parser.add_argument("--seed", type=int, default=314)
+    args = parser.parse_args()
 
-    execute()
+    np.random.seed(args.seed)
+    suite = Suite(args.warmup, args.repetitions, args.batch)
 
-    print("\nBalancing...")
-    tree.balance()
+    for size in [int(s) for s in args.sizes.split(",")]:
+        for distribution in ["sequential", "uniform", "zipf"]:
+            orders = workload(distribution, size)
+            if distribution != "sequential" or size <= args.max_degenerate:
+                run_structure(suite, "BTree", bestbst.BTree, distribution, orders)
+            run_structure(suite, "BTree+auto2", auto_balanced, distribution, orders)
+            run_structure(suite, "RadixTree", bestbst.RadixTree, distribution, orders)
 
-    execute()
+    suite.write_table()
+    if args.json:
+        suite.write_json(args.json)
@@ -1,61 +1,66 @@
 #!/usr/bin/env python3
 
-import time
-import numpy as np
+# Plot the JSON results of benchmarks.py or of the native btree_suite.x: one panel per operation,
+# with the median time per operation against the size of the tree, and the 90th percentile as the
+# upper error bar. Several result files can be given, e.g. to compare C++ and Python, or two
+# commits.
+#
+# usage: plot_benchmark.py results.json [more.json ...] [--distribution uniform] [--output png]
+
+import argparse
+import json
+from collections import defaultdict
+
 import matplotlib
 matplotlib.use('Agg')
 import matplotlib.pyplot as plt
 
-import bestbst
-
-def execute(tree, test_set):
-    start = time.process_time()
-    for i in test_set:
-        tree.find(i)
-    stop = time.process_time()
-
-    return stop - start
-
 
 if __name__ == "__main__":
 
-    _n_tests = 10000
-    _tree_size_max = 1000000
-    _seed = 120
-    _step = 10000
-
-    np.random.seed(_seed)
-
-    tree_length = range(0, _tree_size_max, _step)
-    time_unbalanced = []
-    time_balanced = []
-
-    utree = bestbst.BTree()
-    btree = bestbst.BTree()
-    for length in tree_length:
-        print(length)
-
-        test_set = np.random.rand(_n_tests) * length # To get keys that actually exist
-        test_set = [int(x) for x in test_set]
-
-        [utree.insert(x, 0) for x in np.random.permutation(range(length, length + _step))]
-
-        time_unbalanced.append(execute(utree, test_set))
-
-        [btree.insert(x, 0) for x in range(length, length + _step)]
-        btree.balance()
-
-        time_balanced.append(execute(btree, test_set))
-
-    plt.plot(tree_length, time_unbalanced, label='unbalanced')
-    plt.plot(tree_length, time_balanced, label='balanced')
-    plt.xlabel('Size of the tree')
-    plt.ylabel('Elapsed time ({} finds)'.format(_n_tests))
-    plt.legend()
-
-    plt.savefig('benchmark.png')
-
-    with open('benchmark.dat', 'w') as f:
-        for i in range(len(tree_length)):
-            line = "{} {} {}\n".format(tree_length[i], time_unbalanced[i], time_balanced[i])
-            f.write(line)
+    parser = argparse.ArgumentParser(description="Plot bestbst benchmark results.")
+    parser.add_argument("results", nargs="+")
+    parser.add_argument("--distribution", default="uniform")
+    parser.add_argument("--output", default="benchmark.png")
+    args = parser.parse_args()
+
+    # series[operation][label] = [(size, p50, p90), ...]
+    series = defaultdict(lambda: defaultdict(list))
+    for path in args.results:
+        with open(path) as f:
+            results = json.load(f)
+        language = results["context"].get("language", path)
+        for r in results["benchmarks"]:
+            if r["distribution"] != args.distribution:
+                continue
+            label = r["structure"] if len(args.results) == 1 else \
+                "{} ({})".format(r["structure"], language)
+            s = r["ns_per_op"]
+            series[r["operation"]][label].append((r["size"], s["p50"], s["p90"]))
+
+    operations = sorted(series)
+    columns = 3
+    rows = (len(operations) + columns - 1) // columns
+    fig, axes = plt.subplots(rows, columns, figsize=(5 * columns, 4 * rows), squeeze=False)
+
+    for ax, operation in zip(axes.flat, operations):
+        for label, points in sorted(series[operation].items()):
+            points.sort()
+            sizes = [p[0] for p in points]
+            p50 = [p[1] for p in points]
+            above = [p[2] - p[1] for p in points]
+            ax.errorbar(sizes, p50, yerr=[[0] * len(p50), above], marker='o', capsize=3,
+                        label=label)
+        ax.set_title(operation)
+        ax.set_xscale('log')
+        ax.set_yscale('log')
+        ax.set_xlabel('Size of the tree')
+        ax.set_ylabel('ns per operation (median, p90)')
+        ax.legend(fontsize='small')
+
+    for ax in list(axes.flat)[len(operations):]:
+        ax.set_visible(False)
+
+    fig.suptitle("{} keys".format(args.distribution))
+    fig.tight_layout()
+    fig.savefig(args.output)
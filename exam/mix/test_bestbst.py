@@ -1,6 +1,10 @@
 #!/usr/bin/env python3
+import pickle
+import threading
 import unittest
 
+import numpy as np
+
 import bestbst
 
 
@@ -14,6 +18,214 @@ class MixTest(unittest.TestCase):
         self.tree.insert(12, 1234)
         self.tree.insert(12, 1234)
 
+    def test_stats(self):
+        for x in range(10):
+            self.tree.insert(x, x)
+        stats = self.tree.stats()
+        self.assertEqual(stats["height"], self.tree.height())
+        self.assertEqual(len(stats["visited"]), 64)
+        if stats["enabled"]:
+            self.assertEqual(stats["allocations"], 10)
+
+    def test_memory_usage(self):
+        empty = self.tree.memory_usage()
+        self.assertEqual(empty["nodes"], 0)
+        for x in range(10):
+            self.tree.insert(x, x)
+        usage = self.tree.memory_usage()
+        self.assertEqual(usage["nodes"] % 10, 0)
+        self.assertGreater(usage["nodes"], 0)
+        self.assertEqual(usage["heap"], 0)
+        parts = ["object", "nodes", "slack", "heap"]
+        self.assertEqual(usage["total"], sum(usage[k] for k in parts))
+
+        words = bestbst.make_tree(str, float)
+        words.insert("k" * 100, 1.0)
+        self.assertGreaterEqual(words.memory_usage()["heap"], 101)
+
+    def test_mapping_protocol(self):
+        for x in [5, 3, 8, 1, 4]:
+            self.tree[x] = x * 10
+        self.assertEqual(self.tree[3], 30)
+        self.assertIn(8, self.tree)
+        self.assertNotIn(7, self.tree)
+        self.assertEqual(self.tree.get(7, -1), -1)
+        with self.assertRaises(KeyError):
+            self.tree[7]
+
+        del self.tree[8]
+        self.assertNotIn(8, self.tree)
+        with self.assertRaises(KeyError):
+            del self.tree[8]
+
+    def test_iteration(self):
+        keys = [5, 3, 8, 1, 4]
+        for x in keys:
+            self.tree.insert(x, -x)
+        self.assertEqual(list(self.tree), sorted(keys))
+        self.assertEqual(list(self.tree.keys()), sorted(keys))
+        self.assertEqual(list(self.tree.values()), [-x for x in sorted(keys)])
+        self.assertEqual(list(self.tree.items()), [(x, -x) for x in sorted(keys)])
+        self.assertEqual(self.tree.find(3), (3, -3))
+        self.assertIsNone(self.tree.find(7))
+
+        items = self.tree.items()
+        self.assertEqual(next(items), (1, -1))
+        del self.tree[3]
+        with self.assertRaises(RuntimeError):
+            next(items)
+        with self.assertRaises(RuntimeError):
+            for key in self.tree.range(4):
+                self.tree[key + 100] = key
+
+    def test_range_queries(self):
+        for x in range(0, 20, 2):
+            self.tree.insert(x, x)
+        self.assertEqual([k for k, _ in self.tree.range(3, 9)], [4, 6, 8])
+        self.assertEqual([k for k, _ in self.tree.range(high=3)], [0, 2])
+        self.assertEqual([k for k, _ in self.tree.range(15)], [16, 18])
+        self.assertEqual(self.tree.lower_bound(5), (6, 6))
+        self.assertEqual(self.tree.upper_bound(6), (8, 8))
+        self.assertIsNone(self.tree.upper_bound(18))
+
+    def test_batch_operations(self):
+        keys = np.array([5, 3, 8, 1, 4], dtype=np.int32)
+        self.tree.insert_many(keys, keys * 10)
+        self.assertEqual(len(self.tree), 5)
+
+        values, found = self.tree.find_many(np.array([3, 7, 8]))
+        self.assertEqual(list(found), [True, False, True])
+        self.assertEqual(values[0], 30)
+        self.assertEqual(values[2], 80)
+
+        self.assertEqual(self.tree.erase_many(np.array([1, 2, 3])), 2)
+        self.assertEqual(list(self.tree), [4, 5, 8])
+
+        with self.assertRaises(ValueError):
+            self.tree.insert_many(keys, keys[:2])
+
+    def test_key_value_types(self):
+        words = bestbst.make_tree(key_type=str, value_type=float)
+        self.assertEqual((words.key_type, words.value_type), ("str", "float64"))
+        for word in ["pear", "apple", "fig"]:
+            words[word] = len(word) / 2
+        self.assertEqual(list(words), ["apple", "fig", "pear"])
+        self.assertEqual(words["fig"], 1.5)
+
+        raw = bestbst.make_tree(bytes, "int64")
+        raw[b"\x00\xff"] = 2 ** 40
+        raw[b"\x00"] = -1
+        self.assertEqual(list(raw.items()), [(b"\x00", -1), (b"\x00\xff", 2 ** 40)])
+
+        objects = bestbst.make_tree(float, object)
+        objects[0.5] = ["any", {"python": "object"}]
+        objects[0.5].append(1)
+        self.assertEqual(objects[0.5], ["any", {"python": "object"}, 1])
+
+        wide = bestbst.make_tree(int, int)
+        wide.insert_many(np.array([2 ** 40, -2 ** 40]), np.array([1, 2]))
+        self.assertEqual(list(wide), [-2 ** 40, 2 ** 40])
+
+        self.assertIsInstance(bestbst.make_tree(), bestbst.BTree)
+        self.assertIs(bestbst.BTree_int32_int32, bestbst.BTree)
+
+        class Subclass(bestbst.BTree):
+            pass
+
+        derived = Subclass()
+        derived[1] = 2
+        self.assertEqual(list(derived.items()), [(1, 2)])
+        with self.assertRaises(TypeError):
+            bestbst.make_tree(key_type=list)
+
+    def test_nan_keys(self):
+        floats = bestbst.make_tree(float, int)
+        for x in [5.0, 3.0, 8.0]:
+            floats[x] = int(x)
+        nan = float("nan")
+        with self.assertRaises(ValueError):
+            floats[nan] = 999
+        with self.assertRaises(ValueError):
+            floats.insert(nan, 999)
+        with self.assertRaises(ValueError):
+            floats.insert_many(np.array([1.0, nan]), np.array([1, 2]))
+        with self.assertRaises(ValueError):
+            floats.find(nan)
+        with self.assertRaises(ValueError):
+            nan in floats
+        with self.assertRaises(ValueError):
+            floats.erase_many(np.array([nan]))
+        self.assertEqual(list(floats.items()), [(3.0, 3), (5.0, 5), (8.0, 8)])
+
+    def test_threads(self):
+        keys = np.arange(0, 2000, 2, dtype=np.int32)
+        self.tree.insert_many(keys, keys)
+
+        def read():
+            for _ in range(20):
+                values, found = self.tree.find_many(keys)
+                self.assertTrue(found.all())
+                self.assertTrue((values == keys).all())
+
+        def write():
+            for x in range(1, 2000, 2):
+                self.tree[x] = x
+
+        threads = [threading.Thread(target=read) for _ in range(4)]
+        threads.append(threading.Thread(target=write))
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(len(self.tree), 2000)
+
+    def test_pickle(self):
+        for x in [5, 3, 8, 1, 4]:
+            self.tree[x] = -x
+        copy = pickle.loads(pickle.dumps(self.tree))
+        self.assertIsInstance(copy, bestbst.BTree)
+        self.assertEqual(list(copy.items()), list(self.tree.items()))
+        self.assertTrue(copy.is_balanced())
+
+        keys, values = self.tree.to_numpy()
+        self.assertEqual(keys.dtype, np.int32)
+        self.assertEqual(list(keys), [1, 3, 4, 5, 8])
+        self.assertEqual(list(values), [-1, -3, -4, -5, -8])
+
+        copy.assign_sorted(keys * 2, values)
+        self.assertEqual(list(copy), [2, 6, 8, 10, 16])
+        with self.assertRaises(ValueError):
+            copy.assign_sorted(keys[::-1], values)
+
+        words = bestbst.make_tree(str, object)
+        words["b"] = [1, 2]
+        words["a"] = None
+        copy = pickle.loads(pickle.dumps(words))
+        self.assertEqual(list(copy.items()), [("a", None), ("b", [1, 2])])
+
+    def test_radix_tree(self):
+        radix = bestbst.RadixTree()
+        for x in range(-10, 10):
+            radix.insert(x, x * x)
+        self.assertEqual(len(radix), 20)
+        radix.erase(-10)
+        self.assertEqual(len(radix), 19)
+        self.assertEqual(radix.find(3), (3, 9))
+        self.assertIsNone(radix.find(11))
+
+        self.assertEqual(list(radix), list(range(-9, 10)))
+        self.assertEqual(list(radix.values())[:3], [81, 64, 49])
+        self.assertEqual(list(radix.items())[-1], (9, 81))
+        self.assertEqual(radix.lower_bound(-10), (-9, 81))
+        self.assertEqual(radix.lower_bound(4), (4, 16))
+        self.assertIsNone(radix.lower_bound(10))
+
+        keys = iter(radix)
+        self.assertEqual(next(keys), -9)
+        radix.insert(20, 0)
+        with self.assertRaises(RuntimeError):
+            next(keys)
+
 
 if __name__ == "__main__":
     unittest.main()